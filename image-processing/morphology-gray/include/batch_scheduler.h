@@ -0,0 +1,119 @@
+/**
+ * @brief BatchScheduler class that transforms the FITS files of a manifest,
+ *  loading, operating and writing several of them at once.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "bounded_queue.h"
+#include "chain_cache.h"
+#include "utils.h"
+
+class FitsBatch;
+class FitsImage;
+
+/**
+ * @brief Runs the jobs of a manifest as a pipeline of three stages, each with
+ *  its own threads: loading, operating and writing. The stages are joined by
+ *  bounded queues, which limit the images held in memory, so the disk and the
+ *  engines are busy at the same time. Jobs with the same operations, SEs and
+ *  pixel type share their chain of operations.
+ *
+ *  The manifest has a job per line with the arguments of the command line
+ *  separated by blanks: `<fits_file> <se_file> <output_file> <operation>
+ *  [threshold_type]`. Empty lines and lines starting with `#` are skipped.
+ */
+class BatchScheduler {
+ public:
+  /**
+   * @param options Options applied to every job: I/O threads, compression
+   *  and heterogeneous mode.
+   * @param load_threads Threads that open and load the images.
+   * @param compute_threads Threads that operate on the loaded images.
+   * @param write_threads Threads that write the results.
+   * @param queue_capacity Images waiting at most between two stages.
+   */
+  BatchScheduler(const Options& options, int load_threads,
+                 int compute_threads, int write_threads,
+                 std::size_t queue_capacity);
+  /**
+   * @brief Runs every job of a manifest and prints a line per job and the
+   *  throughput of the whole batch. A failed job does not stop the others.
+   *  Throws an exception if the manifest cannot be read.
+   * @param manifest_file_name The manifest.
+   * @param summary Where the summary is printed.
+   * @returns The amount of failed jobs.
+   */
+  long Run(const std::string& manifest_file_name, std::ostream& summary);
+ private:
+  /**
+   * @brief A job of the manifest.
+   */
+  struct Job {
+    std::string image_file_name;
+    std::string sel_file_name;
+    std::string output_file_name;
+    std::string operation;
+    ThresholdType threshold_type{ThresholdType::NONE};
+  };
+  /**
+   * @brief What happened to a job.
+   */
+  struct Result {
+    std::string error;
+    double load_seconds{0};
+    double compute_seconds{0};
+    double write_seconds{0};
+    // Pixels transformed, 0 for cubes and multi-extension files
+    double pixels{0};
+  };
+  /**
+   * @brief A job moving through the stages. Cubes and multi-extension files
+   *  are transformed whole by the compute stage, with a batch instead of an
+   *  image.
+   */
+  struct Task {
+    std::size_t job;
+    std::unique_ptr<FitsImage> image;
+    std::unique_ptr<FitsBatch> batch;
+    std::shared_ptr<MorphologyChain> chain;
+  };
+
+  /**
+   * @brief Reads the jobs of a manifest. Throws an exception if the file
+   *  cannot be opened or a line is not a job.
+   * @param manifest_file_name The manifest.
+   * @returns The jobs in order.
+   */
+  static std::vector<Job> ReadManifest(const std::string& manifest_file_name);
+  // Opens and loads the images of the jobs, taken in order.
+  void Load();
+  // Operates on the loaded images.
+  void Compute();
+  // Writes the operated images.
+  void Write();
+
+  Options options_;
+  int load_threads_;
+  int compute_threads_;
+  int write_threads_;
+  // Makes the stages take turns with CFITSIO if it is not reentrant
+  std::mutex fits_mutex_;
+  ChainCache chains_;
+  BoundedQueue<std::unique_ptr<Task>> loaded_;
+  BoundedQueue<std::unique_ptr<Task>> operated_;
+  std::vector<Job> jobs_;
+  std::vector<Result> results_;
+  // Next job the load stage takes
+  std::atomic<std::size_t> next_job_{0};
+};
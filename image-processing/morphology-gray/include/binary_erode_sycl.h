@@ -0,0 +1,174 @@
+/**
+ * @brief Erosion of binary images packed in words of bits on a SYCL device.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <sycl/sycl.hpp>
+
+#include "sel_specialization_sycl.h"
+
+template<typename T> class PackKernel;
+template<typename T> class BinaryErodeKernel;
+template<typename T> class UnpackKernel;
+
+namespace BinaryErosion {
+  // Pixels of each packed word, bit `b` of word `w` is the column `32 * w + b`.
+  using PackedWord = std::uint32_t;
+  constexpr int kWordBits = 32;
+  constexpr PackedWord kAllOnes = ~PackedWord{0};
+  // Work-group of the erosion kernel, in rows and words.
+  constexpr std::size_t kGroupRows = 8;
+  constexpr std::size_t kGroupWords = 32;
+
+  /**
+   * @brief Gives the 32 pixels that start `offset` columns away from the first
+   *  pixel of a word, joining the two words they span (a funnel shift).
+   * @param words Callable that gives the packed word at a word column.
+   * @param word Word column of the first pixel.
+   * @param offset Columns to shift, may be negative.
+   * @returns The shifted word.
+   */
+  template<typename Words>
+  inline PackedWord FunnelShift(Words words, long word, int offset) {
+    const long kFirstColumn = word * kWordBits + offset;
+    // Floor division, the offset can point before the first word
+    const long kWord = kFirstColumn >= 0 ? kFirstColumn / kWordBits :
+                       -((kWordBits - 1 - kFirstColumn) / kWordBits);
+    const int kShift = static_cast<int>(kFirstColumn - kWord * kWordBits);
+    PackedWord low = words(kWord);
+    if (kShift == 0) {
+      return low;
+    }
+    PackedWord high = words(kWord + 1);
+    return (low >> kShift) | (high << (kWordBits - kShift));
+  }
+
+  /**
+   * @brief Erodes a band of a padded image after transforming it to binary.
+   *  The band is packed on the device right after the threshold, eroded one
+   *  word at a time from local memory tiles and unpacked into the output.
+   * @param queue Queue of the device holding the image.
+   * @param kernel_bundle Bundle with BinaryErodeKernel specialized for the SE.
+   * @param image_buffer Band with `padding` rows and columns around it.
+   * @param output_buffer Band rows, with `padding` columns at both sides.
+   *  Only the pixels of the image are written.
+   * @param padding Padding amount around the band, at least the SE size.
+   * @param band_rows Amount of rows of the band.
+   * @param columns Amount of columns of the band, without padding.
+   * @param threshold Pixels above it are 1, the rest 0.
+   */
+  template<typename T>
+  void Erode(sycl::queue& queue,
+             sycl::kernel_bundle<sycl::bundle_state::executable>& kernel_bundle,
+             sycl::buffer<T, 2>& image_buffer, sycl::buffer<T, 2>& output_buffer,
+             long padding, long band_rows, long columns, T threshold) {
+    const long kPaddedRows{band_rows + 2 * padding};
+    const long kPaddedColumns{columns + 2 * padding};
+    const long kWords{(kPaddedColumns + kWordBits - 1) / kWordBits};
+    // Words reachable by the SE at each side of a word
+    const long kHaloWords{(padding + kWordBits - 1) / kWordBits + 1};
+    sycl::buffer<PackedWord, 2> packed_buffer{sycl::range(kPaddedRows, kWords)};
+    sycl::buffer<PackedWord, 2> eroded_buffer{sycl::range(band_rows, kWords)};
+
+    // Threshold and pack, the columns past the image are 1 (neutral)
+    queue.submit([&](sycl::handler& handler) {
+      sycl::accessor image_accessor{image_buffer, handler, sycl::read_only};
+      sycl::accessor packed{packed_buffer, handler, sycl::write_only, sycl::no_init};
+      handler.parallel_for<PackKernel<T>>(sycl::range(kPaddedRows, kWords),
+          [=](sycl::item<2> item) {
+        const long kRow = item[0];
+        const long kFirstColumn = item[1] * kWordBits;
+        PackedWord word = 0;
+        for (int bit = 0; bit < kWordBits; ++bit) {
+          const long kColumn = kFirstColumn + bit;
+          if (kColumn >= kPaddedColumns ||
+              image_accessor[kRow][kColumn] > threshold) {
+            word |= PackedWord{1} << bit;
+          }
+        }
+        packed[item] = word;
+      });
+    });
+
+    // Erode
+    const auto kLocalRange = sycl::range(kGroupRows, kGroupWords);
+    const auto kGlobalRange = sycl::range(
+      (band_rows + kGroupRows - 1) / kGroupRows * kGroupRows,
+      (kWords + kGroupWords - 1) / kGroupWords * kGroupWords);
+    const auto kTileRange = sycl::range(kGroupRows + 2 * padding,
+                                        kGroupWords + 2 * kHaloWords);
+    queue.submit([&](sycl::handler& handler) {
+      handler.use_kernel_bundle(kernel_bundle);
+      sycl::accessor packed{packed_buffer, handler, sycl::read_only};
+      sycl::accessor eroded{eroded_buffer, handler, sycl::write_only, sycl::no_init};
+      auto tile = sycl::local_accessor<PackedWord, 2>(kTileRange, handler);
+      handler.parallel_for<BinaryErodeKernel<T>>(
+          sycl::nd_range(kGlobalRange, kLocalRange),
+          [=](sycl::nd_item<2> item, sycl::kernel_handler kernel_handler) {
+        const int kRows = kernel_handler.get_specialization_constant<kSelRows>();
+        const int kColumns =
+          kernel_handler.get_specialization_constant<kSelColumns>();
+        const int kCenterRow =
+          kernel_handler.get_specialization_constant<kSelCenterRow>();
+        const int kCenterColumn =
+          kernel_handler.get_specialization_constant<kSelCenterColumn>();
+        const PackedSelMask kMask =
+          kernel_handler.get_specialization_constant<kSelMask>();
+        const long kGroupRow = item.get_group(0) * kGroupRows;
+        const long kGroupWord = item.get_group(1) * kGroupWords;
+        const long kLocalRow = item.get_local_id(0);
+        const long kLocalWord = item.get_local_id(1);
+
+        // Load tile, the words outside of the packed image are 1
+        for (long row = kLocalRow; row < kTileRange[0]; row += kGroupRows) {
+          for (long word = kLocalWord; word < kTileRange[1]; word += kGroupWords) {
+            const long kRow = kGroupRow + row;
+            const long kWord = kGroupWord + word - kHaloWords;
+            tile[row][word] = kRow < kPaddedRows && kWord >= 0 && kWord < kWords ?
+                              packed[kRow][kWord] : kAllOnes;
+          }
+        }
+        sycl::group_barrier(item.get_group());
+        if (kGroupRow + kLocalRow >= band_rows ||
+            kGroupWord + kLocalWord >= kWords) {
+          return;
+        }
+
+        // Vertical taps are an AND of words, horizontal ones a funnel shift
+        const long kTileRow = kLocalRow + padding;
+        const long kTileWord = kLocalWord + kHaloWords;
+        PackedWord result = kAllOnes;
+        for (int row = 0; row < kRows; ++row) {
+          const long kNeighbourRow = kTileRow + row - kCenterRow;
+          auto words = [&](long word) { return tile[kNeighbourRow][word]; };
+          for (int column = 0; column < kColumns; ++column) {
+            const int kCell = row * kColumns + column;
+            if (((kMask.words[kCell / 64] >> (kCell % 64)) & 1) == 0) {
+              continue;
+            }
+            result &= FunnelShift(words, kTileWord, column - kCenterColumn);
+          }
+        }
+        eroded[kGroupRow + kLocalRow][kGroupWord + kLocalWord] = result;
+      });
+    });
+
+    // Unpack into the pixels of the image
+    queue.submit([&](sycl::handler& handler) {
+      sycl::accessor eroded{eroded_buffer, handler, sycl::read_only};
+      sycl::accessor output_accessor{output_buffer, handler, sycl::write_only};
+      handler.parallel_for<UnpackKernel<T>>(sycl::range(band_rows, columns),
+          [=](sycl::item<2> item) {
+        const long kColumn = item[1] + padding;
+        const PackedWord kWord = eroded[item[0]][kColumn / kWordBits];
+        output_accessor[item[0]][kColumn] =
+          ((kWord >> (kColumn % kWordBits)) & 1) ? static_cast<T>(1) :
+                                                   static_cast<T>(0);
+      });
+    });
+  }
+}
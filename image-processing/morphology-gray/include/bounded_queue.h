@@ -0,0 +1,82 @@
+/**
+ * @brief BoundedQueue class that hands items between threads, making the
+ *  producers wait while it is full.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+/**
+ * @brief Queue of a fixed capacity shared by several producers and consumers.
+ *  Once closed, no item is pushed and the consumers take the remaining ones.
+ * @tparam T Type of the items.
+ */
+template <typename T>
+class BoundedQueue {
+ public:
+  /**
+   * @param capacity Items queued at most.
+   */
+  explicit BoundedQueue(std::size_t capacity):
+      capacity_{std::max<std::size_t>(capacity, 1)} {}
+  /**
+   * @brief Queues an item, waiting while the queue is full.
+   * @param item The item to queue.
+   * @returns False if the queue was closed, true otherwise.
+   */
+  bool Push(T item) {
+    {
+      std::unique_lock<std::mutex> lock{mutex_};
+      not_full_.wait(lock, [this]() {
+        return closed_ || items_.size() < capacity_;
+      });
+      if (closed_) {
+        return false;
+      }
+      items_.push_back(std::move(item));
+    }
+    not_empty_.notify_one();
+    return true;
+  }
+  /**
+   * @brief Takes the oldest item, waiting while the queue is empty.
+   * @param item Where the item is moved.
+   * @returns False if the queue is closed and empty, true otherwise.
+   */
+  bool Pop(T& item) {
+    {
+      std::unique_lock<std::mutex> lock{mutex_};
+      not_empty_.wait(lock, [this]() { return closed_ || !items_.empty(); });
+      if (items_.empty()) {
+        return false;
+      }
+      item = std::move(items_.front());
+      items_.pop_front();
+    }
+    not_full_.notify_one();
+    return true;
+  }
+  // Rejects new items and wakes every waiting thread.
+  void Close() {
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      closed_ = true;
+    }
+    not_empty_.notify_all();
+    not_full_.notify_all();
+  }
+ private:
+  std::size_t capacity_;
+  std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+  std::deque<T> items_;
+  bool closed_{false};
+};
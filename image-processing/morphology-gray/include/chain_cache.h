@@ -0,0 +1,64 @@
+/**
+ * @brief ChainCache class that keeps the chains of operations, with their
+ *  parsed SEs and engines, between jobs.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "morphology.h"
+
+class MorphologyChain;
+
+/**
+ * @brief Chains of operations shared by the jobs with the same operations,
+ *  SE files, pixel type and threshold. A chain is created again when one of
+ *  its SE files is modified, and the least recently used one is dropped when
+ *  the cache is full. Jobs still using a dropped chain keep it alive.
+ */
+class ChainCache {
+ public:
+  /**
+   * @param heterogeneous Splits the erosions of the chains among every engine.
+   * @param capacity Chains kept at most.
+   */
+  explicit ChainCache(bool heterogeneous, std::size_t capacity = 64);
+  /**
+   * @brief Gives the chain of a job, creating it if it is not cached. Throws
+   *  an exception if the chain cannot be created.
+   * @param operations User's input for the operations.
+   * @param sel_file_names Comma-separated SE files, one per operation.
+   * @param data_type CFITSIO data type of the image.
+   * @param threshold_type Threshold of the first operation.
+   * @returns The chain of operations.
+   */
+  std::shared_ptr<MorphologyChain> Get(const std::string& operations,
+                                       const std::string& sel_file_names,
+                                       int data_type,
+                                       ThresholdType threshold_type);
+ private:
+  /**
+   * @brief A chain of operations and when it was created and used.
+   */
+  struct Entry {
+    std::shared_ptr<MorphologyChain> chain;
+    // Modification times of the SE files the chain was created from
+    std::vector<std::filesystem::file_time_type> sel_times;
+    unsigned long last_use{0};
+  };
+
+  bool heterogeneous_;
+  std::size_t capacity_;
+  std::mutex mutex_;
+  std::map<std::string, Entry> entries_;
+  unsigned long uses_{0};
+};
@@ -0,0 +1,230 @@
+/**
+ * @brief Pool of USM blocks shared by every SYCL engine, so the
+ *  temporaries of an operation are reused by the following ones.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <algorithm>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <sycl/sycl.hpp>
+
+/**
+ * @brief Hands out USM blocks by size class, device and kind, and keeps the
+ *  released ones to hand them out again. Processing frames of the same size
+ *  allocates device and pinned host memory only for the first one. The
+ *  blocks kept idle are limited in bytes, the least recently released ones
+ *  are freed first, so a long-running process does not keep a block of every
+ *  size it ever used.
+ */
+class DevicePool {
+ public:
+  /**
+   * @brief USM block borrowed from the pool, given back when destroyed.
+   */
+  class Block {
+   public:
+    Block() {}
+    Block(const Block&) = delete;
+    Block& operator=(const Block&) = delete;
+    Block(Block&& other) noexcept { *this = std::move(other); }
+    Block& operator=(Block&& other) noexcept {
+      std::swap(pool_, other.pool_);
+      std::swap(queue_, other.queue_);
+      std::swap(size_class_, other.size_class_);
+      std::swap(kind_, other.kind_);
+      std::swap(pointer_, other.pointer_);
+      return *this;
+    }
+    ~Block() {
+      if (pointer_ != nullptr) {
+        pool_->Release(queue_, size_class_, kind_, pointer_);
+      }
+    }
+    // Gives the memory of the block as an array of T.
+    template<typename T>
+    inline T* Get() const { return static_cast<T*>(pointer_); }
+   private:
+    friend class DevicePool;
+    Block(DevicePool* pool, const sycl::queue& queue, std::size_t size_class,
+          sycl::usm::alloc kind, void* pointer):
+        pool_{pool}, queue_{queue}, size_class_{size_class}, kind_{kind},
+        pointer_{pointer} {}
+
+    DevicePool* pool_{nullptr};
+    sycl::queue queue_;
+    std::size_t size_class_{0};
+    sycl::usm::alloc kind_{sycl::usm::alloc::device};
+    void* pointer_{nullptr};
+  };
+
+  // Returns the pool of the process.
+  static DevicePool& Instance() {
+    // Never destroyed, the runtime may be gone before the static destructors
+    static DevicePool* pool{new DevicePool};
+    return *pool;
+  }
+  /**
+   * @brief Borrows a block of at least the given size. Throws an exception if
+   *  there is no memory left even without the cached blocks.
+   * @param queue Queue of the device the block is used on.
+   * @param bytes Size of the block.
+   * @param kind Device memory, or pinned host memory to stage transfers.
+   * @returns The block.
+   */
+  Block Acquire(const sycl::queue& queue, std::size_t bytes,
+                sycl::usm::alloc kind = sycl::usm::alloc::device) {
+    const std::size_t kSizeClass{SizeClass(bytes)};
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      auto cached = free_blocks_.find(Key{queue.get_context(), queue.get_device(),
+                                          kSizeClass, kind});
+      if (cached != free_blocks_.end() && !cached->second.empty()) {
+        auto idle_block = cached->second.back();
+        cached->second.pop_back();
+        void* pointer{idle_block->pointer};
+        idle_blocks_.erase(idle_block);
+        idle_bytes_ -= kSizeClass;
+        return Block{this, queue, kSizeClass, kind, pointer};
+      }
+    }
+    void* pointer{sycl::malloc(kSizeClass, queue, kind)};
+    if (pointer == nullptr) {
+      // The cached blocks of other sizes may be in the way
+      Trim();
+      pointer = sycl::malloc(kSizeClass, queue, kind);
+    }
+    if (pointer == nullptr) {
+      throw std::runtime_error("Out of USM memory.");
+    }
+    return Block{this, queue, kSizeClass, kind, pointer};
+  }
+  // Frees every cached block.
+  void Trim() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    for (const IdleBlock& idle_block : idle_blocks_) {
+      sycl::free(idle_block.pointer, idle_block.key.context);
+    }
+    idle_blocks_.clear();
+    free_blocks_.clear();
+    idle_bytes_ = 0;
+  }
+  /**
+   * @brief Limits the memory of the cached blocks, freeing the least recently
+   *  released ones above it.
+   * @param bytes Bytes of device and pinned host memory kept idle at most.
+   */
+  void SetIdleLimit(std::size_t bytes) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    idle_limit_ = bytes;
+    FreeAboveLimit();
+  }
+ private:
+  // Smallest block handed out.
+  static constexpr std::size_t kMinimumBlock = 4096;
+  // Size classes between two consecutive powers of two.
+  static constexpr int kClassesPerPowerOfTwo = 4;
+  // Bytes kept idle at most unless SetIdleLimit() says otherwise.
+  static constexpr std::size_t kDefaultIdleLimit = std::size_t{2} << 30;
+
+  /**
+   * @brief Identifies the cached blocks that can be handed out together.
+   */
+  struct Key {
+    sycl::context context;
+    sycl::device device;
+    std::size_t size_class;
+    sycl::usm::alloc kind;
+    bool operator==(const Key& other) const {
+      return context == other.context && device == other.device &&
+             size_class == other.size_class && kind == other.kind;
+    }
+  };
+  struct KeyHash {
+    std::size_t operator()(const Key& key) const {
+      std::size_t hash{std::hash<sycl::context>{}(key.context)};
+      hash ^= std::hash<sycl::device>{}(key.device) + 0x9e3779b97f4a7c15ULL +
+              (hash << 6) + (hash >> 2);
+      hash ^= key.size_class + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+      hash ^= static_cast<std::size_t>(key.kind) + 0x9e3779b97f4a7c15ULL +
+              (hash << 6) + (hash >> 2);
+      return hash;
+    }
+  };
+  /**
+   * @brief A cached block, in the order they were released.
+   */
+  struct IdleBlock {
+    Key key;
+    void* pointer;
+  };
+  using IdleBlocks = std::list<IdleBlock>;
+
+  DevicePool() {}
+  /**
+   * @brief Rounds a size up to its class, a quarter of a power of two, so
+   *  at most a fourth of a block is wasted.
+   * @param bytes Size to round.
+   * @returns The size of the class.
+   */
+  static std::size_t SizeClass(std::size_t bytes) {
+    if (bytes <= kMinimumBlock) {
+      return kMinimumBlock;
+    }
+    std::size_t power{kMinimumBlock};
+    while (power < bytes) {
+      power <<= 1;
+    }
+    const std::size_t kStep{power / 2 / kClassesPerPowerOfTwo};
+    return (bytes + kStep - 1) / kStep * kStep;
+  }
+  /**
+   * @brief Keeps a block to hand it out again.
+   * @param queue Queue of the device of the block.
+   * @param size_class Size class of the block.
+   * @param kind Kind of USM of the block.
+   * @param pointer The block.
+   */
+  void Release(const sycl::queue& queue, std::size_t size_class,
+               sycl::usm::alloc kind, void* pointer) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    const Key kKey{queue.get_context(), queue.get_device(), size_class, kind};
+    idle_blocks_.push_back({kKey, pointer});
+    free_blocks_[kKey].push_back(std::prev(idle_blocks_.end()));
+    idle_bytes_ += size_class;
+    FreeAboveLimit();
+  }
+  // Frees the oldest cached blocks until they fit in the limit, mutex_ held.
+  void FreeAboveLimit() {
+    while (idle_bytes_ > idle_limit_ && !idle_blocks_.empty()) {
+      const IdleBlock& oldest = idle_blocks_.front();
+      std::vector<IdleBlocks::iterator>& same_blocks = free_blocks_[oldest.key];
+      same_blocks.erase(std::find(same_blocks.begin(), same_blocks.end(),
+                                  idle_blocks_.begin()));
+      if (same_blocks.empty()) {
+        free_blocks_.erase(oldest.key);
+      }
+      sycl::free(oldest.pointer, oldest.key.context);
+      idle_bytes_ -= oldest.key.size_class;
+      idle_blocks_.pop_front();
+    }
+  }
+
+  std::mutex mutex_;
+  // Cached blocks, least recently released first
+  IdleBlocks idle_blocks_;
+  // Cached blocks by key, the most recently released last
+  std::unordered_map<Key, std::vector<IdleBlocks::iterator>, KeyHash>
+    free_blocks_;
+  std::size_t idle_bytes_{0};
+  std::size_t idle_limit_{kDefaultIdleLimit};
+};
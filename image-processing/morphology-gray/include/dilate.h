@@ -0,0 +1,54 @@
+/**
+ * @brief Dilate class which implements the morphological dilation operation.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#pragma once
+
+#include "morphology.h"
+
+#include <algorithm>
+
+#include "templated_fits_image.h"
+#include "templated_structuring_element.h"
+#include "erode_region.h"
+
+/**
+ * @brief Performs a morphological dilation operation.
+ */
+template<typename T>
+class Dilate: public Morphology {
+ public:
+  Dilate() {}
+  ~Dilate() override {}
+  /**
+   * @brief Performs a morphological dilation on the image with the structuring
+   *  element.
+   * @param image FITS image to transform.
+   * @param sel Structuring element for the operation.
+   */
+  void Operate(FitsImage* fits_image, StructuringElement* operation_sel) override {
+    TemplatedFitsImage<T>& image =
+      *dynamic_cast<TemplatedFitsImage<T>*>(fits_image);
+    TemplatedStructuringElement<T>& sel =
+      *dynamic_cast<TemplatedStructuringElement<T>*>(operation_sel);
+    ApplyThreshold(fits_image);
+    // Reads the image and writes the other buffer, which becomes the image
+    const T* source = image.GetData();
+    T* destination = image.GetScratch();
+    long origin = image.Padding() * image.RowPitch() + image.Padding();
+    DilateRegion(source + origin, destination + origin, image.Rows(),
+                 image.Columns(), image.RowPitch(), sel);
+    image.SwapScratch();
+  }
+};
+
+/**
+ * @brief Creates a Dilate instance using dynamic memory. Is the user's
+ *  responsibility to free the memory.
+ * @param data_type The type of data it operates with.
+ *  Uses CFITSIO data type enum.
+ * @returns A Dilate object as its base class poiner.
+ */
+Morphology* NewDilate(int data_type);
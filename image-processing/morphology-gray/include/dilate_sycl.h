@@ -0,0 +1,125 @@
+/**
+ * @brief Dilate class which implements the morphological dilation operation.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#pragma once
+
+#include "morphology.h"
+
+#include <sycl/sycl.hpp>
+
+#include "templated_fits_image.h"
+#include "templated_structuring_element.h"
+#include "fits_utils.h"
+#include "sel_specialization_sycl.h"
+#include "device_pool_sycl.h"
+#include "trace_sycl.h"
+
+template<typename T> class DilateKernel;
+
+/**
+ * @brief Performs a morphological dilation operation.
+ */
+template<typename T>
+class Dilate: public Morphology {
+ public:
+  Dilate(): Dilate{sycl::queue{sycl::gpu_selector_v, Trace::QueueProperties()}} {}
+  /**
+   * @brief Creates a dilation engine that runs on the given queue.
+   * @param queue Queue of the device to dilate with.
+   */
+  explicit Dilate(sycl::queue queue):
+      queue_{queue},
+      kernel_cache_{queue_, {sycl::get_kernel_id<DilateKernel<T>>()}} {}
+  ~Dilate() override {}
+  /**
+   * @brief Builds the kernels specialized for the structuring element.
+   * @param operation_sel Structuring element the operation will use.
+   */
+  void Prepare(StructuringElement* operation_sel) override {
+    Trace::Scope trace_scope{"build kernels"};
+    kernel_cache_.Get(
+      *dynamic_cast<TemplatedStructuringElement<T>*>(operation_sel));
+  }
+  /**
+   * @brief Performs a morphological dilation on the image with the structuring
+   *  element.
+   * @param image FITS image to transform.
+   * @param sel Structuring element for the operation.
+   */
+  void Operate(FitsImage* fits_image, StructuringElement* operation_sel) override {
+    TemplatedFitsImage<T>& image =
+      *dynamic_cast<TemplatedFitsImage<T>*>(fits_image);
+    TemplatedStructuringElement<T>& sel =
+      *dynamic_cast<TemplatedStructuringElement<T>*>(operation_sel);
+    ApplyThreshold(fits_image);
+    auto& kernel_bundle = kernel_cache_.Get(sel);
+    const long kPadding{image.Padding()};
+    const long kPitch{image.RowPitch()};
+    const long kRows{image.Rows()};
+    const long kColumns{image.Columns()};
+    const T kFilling = image.GetFilling(PaddingType::MIN, 0);
+    const auto kImageRange = sycl::range(kRows, kColumns);
+    // Only the pixels of the image are sent and received, the padding is
+    // filled by the kernel. The pinned staging holds the input and then the
+    // output.
+    const std::size_t kImageBytes = kRows * kColumns * sizeof(T);
+    DevicePool& pool = DevicePool::Instance();
+    DevicePool::Block staging_block =
+      pool.Acquire(queue_, kImageBytes, sycl::usm::alloc::host);
+    DevicePool::Block input_block = pool.Acquire(queue_, kImageBytes);
+    DevicePool::Block output_block = pool.Acquire(queue_, kImageBytes);
+    T* staging = staging_block.Get<T>();
+    const T* input = input_block.Get<T>();
+    T* output = output_block.Get<T>();
+    {
+      Trace::Scope trace_scope{"pack", kImageBytes};
+      FitsUtils::PackRows(image.GetData(), kPitch, kPadding, 0L, kRows,
+                          kColumns, staging);
+    }
+    auto upload = queue_.memcpy(input_block.Get<T>(), staging, kImageBytes);
+    auto dilation = queue_.submit([&](sycl::handler& handler) {
+      handler.depends_on(upload);
+      handler.use_kernel_bundle(kernel_bundle);
+      handler.parallel_for<DilateKernel<T>>(kImageRange,
+          [=](sycl::item<2> item, sycl::kernel_handler kernel_handler) {
+        const long kRow = item[0];
+        const long kColumn = item[1];
+        output[kRow * kColumns + kColumn] =
+          DilatePixel<T>(kernel_handler, [&](int row, int column) {
+            const long kNeighbourRow = kRow + row;
+            const long kNeighbourColumn = kColumn + column;
+            return kNeighbourRow >= 0 && kNeighbourRow < kRows &&
+                   kNeighbourColumn >= 0 && kNeighbourColumn < kColumns ?
+                   input[kNeighbourRow * kColumns + kNeighbourColumn] :
+                   kFilling;
+          });
+      });
+    });
+    auto download = queue_.memcpy(staging, output, kImageBytes, dilation);
+    queue_.wait_and_throw();
+    {
+      Trace::Scope trace_scope{"unpack", kImageBytes};
+      FitsUtils::UnpackRows(staging, kPitch, kPadding, 0L, kRows, kColumns,
+                            image.GetData());
+    }
+    Trace::AddDeviceCommands(queue_.get_device(), {
+      {"upload", upload, kImageBytes},
+      {"dilate kernel", dilation, 0},
+      {"download", download, kImageBytes}});
+  }
+ private:
+  sycl::queue queue_;
+  SelKernelCache<T> kernel_cache_;
+};
+
+/**
+ * @brief Creates a Dilate instance using dynamic memory. Is the user's
+ *  responsibility to free the memory.
+ * @param data_type The type of data it operates with.
+ *  Uses CFITSIO data type enum.
+ * @returns A Dilate object as its base class poiner.
+ */
+Morphology* NewDilate(int data_type);
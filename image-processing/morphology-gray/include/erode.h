@@ -8,11 +8,11 @@
 
 #include "morphology.h"
 
-#include <limits>
 #include <algorithm>
 
 #include "templated_fits_image.h"
 #include "templated_structuring_element.h"
+#include "erode_region.h"
 
 /**
  * @brief Performs a morphological erosion operation.
@@ -33,34 +33,14 @@ class Erode: public Morphology {
       *dynamic_cast<TemplatedFitsImage<T>*>(fits_image);
     TemplatedStructuringElement<T>& sel =
       *dynamic_cast<TemplatedStructuringElement<T>*>(operation_sel);
-    T* image_data = image.GetData();
-    T* image_data_copy = new T[image.PaddedTotalElements()];
-    std::copy(image_data, image_data + image.PaddedTotalElements(), image_data_copy);
-    T* sel_data = sel.GetData();
-    long origin = image.Padding() * image.PaddedColumns() + image.Padding();
-    for (long row{0}; row < image.Rows(); ++row) {
-      long image_row = origin + row * image.PaddedColumns();
-      for (long column{0}; column < image.Columns(); ++column) {
-        long pixel_index = image_row + column;
-        long local_origin = pixel_index -
-                            sel.CenterRow() * image.PaddedColumns() -
-                            sel.CenterColumn();
-        T minimum = std::numeric_limits<T>::max();
-        for (long local_row{0}; local_row < sel.Rows(); ++local_row) {
-          long local_image_row = local_origin + local_row * image.PaddedColumns();
-          long sel_row = local_row * sel.Columns();
-          for (long local_column{0}; local_column < sel.Columns(); ++local_column) {
-            long local_pixel = local_image_row + local_column;
-            if (sel_data[sel_row + local_column] == 1 && 
-                image_data_copy[local_pixel] <= minimum) {
-              minimum = image_data_copy[local_pixel];
-            }
-          }
-        }
-        image_data[pixel_index] = minimum;
-      }
-    }
-    delete[] image_data_copy;
+    ApplyThreshold(fits_image);
+    // Reads the image and writes the other buffer, which becomes the image
+    const T* source = image.GetData();
+    T* destination = image.GetScratch();
+    long origin = image.Padding() * image.RowPitch() + image.Padding();
+    ErodeRegion(source + origin, destination + origin, image.Rows(),
+                image.Columns(), image.RowPitch(), sel);
+    image.SwapScratch();
   }
 };
 
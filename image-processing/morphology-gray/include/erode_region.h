@@ -0,0 +1,115 @@
+/**
+ * @brief Host implementation of the erosion and the dilation over a region of
+ *  a padded image, shared by every engine that works on the CPU.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#pragma once
+
+#include <limits>
+
+#include "templated_structuring_element.h"
+
+/**
+ * @brief Erodes a rectangular region of an image. The source must be readable
+ *  up to the SE reach around the region.
+ * @param source First pixel of the region in the source image.
+ * @param source_pitch Distance, in elements, between two consecutive rows of
+ *  the source.
+ * @param destination First pixel of the region in the destination image.
+ *  Must not overlap the source.
+ * @param destination_pitch Distance, in elements, between two consecutive
+ *  rows of the destination.
+ * @param rows Amount of rows of the region.
+ * @param columns Amount of columns of the region.
+ * @param sel Structuring element for the operation.
+ */
+template<typename T>
+void ErodeRegion(const T* source, long source_pitch, T* destination,
+                 long destination_pitch, long rows, long columns,
+                 TemplatedStructuringElement<T>& sel) {
+  const T* sel_data = sel.GetData();
+  for (long row{0}; row < rows; ++row) {
+    long image_row = row * source_pitch;
+    T* destination_row = destination + row * destination_pitch;
+    for (long column{0}; column < columns; ++column) {
+      long pixel_index = image_row + column;
+      long local_origin = pixel_index -
+                          sel.CenterRow() * source_pitch -
+                          sel.CenterColumn();
+      T minimum = std::numeric_limits<T>::max();
+      for (long local_row{0}; local_row < sel.Rows(); ++local_row) {
+        long local_image_row = local_origin + local_row * source_pitch;
+        long sel_row = local_row * sel.Columns();
+        for (long local_column{0}; local_column < sel.Columns(); ++local_column) {
+          long local_pixel = local_image_row + local_column;
+          if (sel_data[sel_row + local_column] == 1 &&
+              source[local_pixel] <= minimum) {
+            minimum = source[local_pixel];
+          }
+        }
+      }
+      destination_row[column] = minimum;
+    }
+  }
+}
+
+/**
+ * @brief Erodes a rectangular region of a padded image. The source must be
+ *  readable up to the SE reach around the region.
+ * @param source First pixel of the region in the source image.
+ * @param destination First pixel of the region in the destination image.
+ *  Must not overlap the source.
+ * @param rows Amount of rows of the region.
+ * @param columns Amount of columns of the region.
+ * @param row_pitch Distance, in elements, between two consecutive rows of both
+ *  the source and the destination.
+ * @param sel Structuring element for the operation.
+ */
+template<typename T>
+void ErodeRegion(const T* source, T* destination, long rows, long columns,
+                 long row_pitch, TemplatedStructuringElement<T>& sel) {
+  ErodeRegion(source, row_pitch, destination, row_pitch, rows, columns, sel);
+}
+
+/**
+ * @brief Dilates a rectangular region of a padded image with the SE reflected
+ *  around its origin. The source must be readable up to the SE reach around
+ *  the region.
+ * @param source First pixel of the region in the source image.
+ * @param destination First pixel of the region in the destination image.
+ *  Must not overlap the source.
+ * @param rows Amount of rows of the region.
+ * @param columns Amount of columns of the region.
+ * @param row_pitch Distance, in elements, between two consecutive rows of both
+ *  the source and the destination.
+ * @param sel Structuring element for the operation.
+ */
+template<typename T>
+void DilateRegion(const T* source, T* destination, long rows, long columns,
+                  long row_pitch, TemplatedStructuringElement<T>& sel) {
+  const T* sel_data = sel.GetData();
+  for (long row{0}; row < rows; ++row) {
+    long image_row = row * row_pitch;
+    for (long column{0}; column < columns; ++column) {
+      long pixel_index = image_row + column;
+      long local_origin = pixel_index +
+                          sel.CenterRow() * row_pitch +
+                          sel.CenterColumn();
+      T maximum = std::numeric_limits<T>::lowest();
+      for (long local_row{0}; local_row < sel.Rows(); ++local_row) {
+        long local_image_row = local_origin - local_row * row_pitch;
+        long sel_row = local_row * sel.Columns();
+        for (long local_column{0}; local_column < sel.Columns(); ++local_column) {
+          long local_pixel = local_image_row - local_column;
+          if (sel_data[sel_row + local_column] == 1 &&
+              source[local_pixel] >= maximum) {
+            maximum = source[local_pixel];
+          }
+        }
+      }
+      destination[pixel_index] = maximum;
+    }
+  }
+}
@@ -1,6 +1,6 @@
 /**
  * @brief Erode class which implements the morphological erosion operation.
- * 
+ *
  * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
  */
 
@@ -15,6 +15,13 @@
 #include "templated_fits_image.h"
 #include "templated_structuring_element.h"
 #include "fits_utils.h"
+#include "sel_specialization_sycl.h"
+#include "device_pool_sycl.h"
+#include "trace_sycl.h"
+#include "statistics_sycl.h"
+#include "binary_erode_sycl.h"
+
+template<typename T> class ErodeKernel;
 
 /**
  * @brief Performs a morphological erosion operation.
@@ -22,8 +29,25 @@
 template<typename T>
 class Erode: public Morphology {
  public:
-  Erode() {}
+  Erode(): Erode{sycl::queue{sycl::gpu_selector_v, Trace::QueueProperties()}} {}
+  /**
+   * @brief Creates an erosion engine that runs on the given queue.
+   * @param queue Queue of the device to erode with.
+   */
+  explicit Erode(sycl::queue queue):
+      queue_{queue},
+      kernel_cache_{queue_, {sycl::get_kernel_id<ErodeKernel<T>>(),
+                             sycl::get_kernel_id<BinaryErodeKernel<T>>()}} {}
   ~Erode() override {}
+  /**
+   * @brief Builds the kernels specialized for the structuring element.
+   * @param operation_sel Structuring element the operation will use.
+   */
+  void Prepare(StructuringElement* operation_sel) override {
+    Trace::Scope trace_scope{"build kernels"};
+    kernel_cache_.Get(
+      *dynamic_cast<TemplatedStructuringElement<T>*>(operation_sel));
+  }
   /**
    * @brief Performs a morphological erosion on the image with the structuring
    *  element.
@@ -31,83 +55,196 @@ class Erode: public Morphology {
    * @param sel Structuring element for the operation.
    */
   void Operate(FitsImage* fits_image, StructuringElement* operation_sel) override {
-    sycl::queue queue{sycl::gpu_selector_v};
     TemplatedFitsImage<T>& image =
       *dynamic_cast<TemplatedFitsImage<T>*>(fits_image);
     TemplatedStructuringElement<T>& sel =
       *dynamic_cast<TemplatedStructuringElement<T>*>(operation_sel);
-    T* image_data = image.GetData();
-    T* sel_data = sel.GetData();
-
-    const long kTwicePadding = 2 * image.Padding();
-    auto twice_padding_range = sycl::range(kTwicePadding, kTwicePadding);
-    auto padding_range = sycl::range(image.Padding(), image.Padding());
-    auto sel_offset =
-      padding_range - sycl::range(sel.CenterRow(), sel.CenterColumn());
+    OperateBand(image, sel, image.GetData(), image.GetData(), 0, image.Rows(),
+                threshold_type_);
+    if (threshold_type_ != ThresholdType::NONE) {
+      // Binary pixels, compared with the raw ones so no scaling is left
+      image.ClearScaling();
+    }
+  }
+  /**
+   * @brief Performs a morphological erosion on a band of rows of the image.
+   *  Only the rows of the band are written, so several bands can be eroded
+   *  concurrently.
+   * @param image FITS image to transform.
+   * @param sel Structuring element for the operation.
+   * @param source Padded pixels to erode, laid out like the image data. Must
+   *  not be modified while other bands are being eroded.
+   * @param destination Where the eroded rows of the band are written, laid
+   *  out like the image data. May be the source, the band is read before it
+   *  is written.
+   * @param first_row First row of the band, without padding.
+   * @param band_rows Amount of rows of the band.
+   * @param threshold_type Threshold to transform the band to binary on the
+   *  device before the erosion, calculated from the pixels of the band. The
+   *  binary band is eroded packed in words of bits.
+   */
+  void OperateBand(TemplatedFitsImage<T>& image,
+                   TemplatedStructuringElement<T>& sel,
+                   const T* source, T* destination, long first_row,
+                   long band_rows,
+                   ThresholdType threshold_type = ThresholdType::NONE) {
+    if (band_rows <= 0) {
+      return;
+    }
+    auto& kernel_bundle = kernel_cache_.Get(sel);
+    if (threshold_type != ThresholdType::NONE) {
+      OperateBinaryBand(image, kernel_bundle, source, destination, first_row,
+                        band_rows, threshold_type);
+      return;
+    }
 
-    { // Buffer scope
+    const long kPadding = image.Padding();
+    const long kPitch = image.RowPitch();
+    const long kColumns = image.Columns();
+    // Only the pixels of the image are sent: the band and the rows of its
+    // halo that are inside the image
+    const long kFirstInputRow = std::max(first_row - kPadding, 0L);
+    const long kInputRows =
+      std::min(first_row + band_rows + kPadding, image.Rows()) - kFirstInputRow;
+    // Padded band row of the first input row
+    const long kInputRowShift = kPadding - (first_row - kFirstInputRow);
+    const T kFilling = image.GetFilling(PaddingType::MAX, 0);
+    auto twice_padding_range = sycl::range(2 * kPadding, 2 * kPadding);
+    auto padding_range = sycl::range(kPadding, kPadding);
     // CG Ranges
     auto local_range = sycl::range(sel.Rows(), sel.Columns());
     int column_work_groups_amount =
-      FitsUtils::DivisionCeiling(image.Columns(), local_range[1]);
+      FitsUtils::DivisionCeiling(kColumns, local_range[1]);
     int row_work_groups_amount =
-      FitsUtils::DivisionCeiling(image.Rows(), local_range[0]);
+      FitsUtils::DivisionCeiling(band_rows, local_range[0]);
     auto global_range = sycl::range(local_range[0] * row_work_groups_amount,
                                     local_range[1] * column_work_groups_amount);
     auto nd_range = sycl::nd_range(global_range, local_range);
-    // Buffer Ranges
-    auto image_buffer_range =
-      sycl::range(image.PaddedRows(), image.PaddedColumns());
-    auto output_buffer_range =
-      sycl::range(image.PaddedRows(), image.PaddedColumns());
-    auto sel_buffer_range = sycl::range(sel.Rows(), sel.Columns());
-    auto tile_range = local_range + twice_padding_range; // - sycl::range(1, 1)
-    // Buffers
-    auto image_buffer = sycl::buffer{image_data, image_buffer_range};
-    image_buffer.set_final_data(nullptr);
-    auto output_buffer = sycl::buffer<T, 2>{output_buffer_range};
-    output_buffer.set_final_data(image_data);
-    auto sel_buffer = sycl::buffer{sel_data, sel_buffer_range};
+    auto band_range = sycl::range(band_rows, kColumns);
+    auto tile_range = local_range + twice_padding_range;
+    // Unpadded blocks from the pool, reused by the next band or frame. The
+    // pinned staging holds the input and then the output, which is smaller
+    const std::size_t kInputBytes = kInputRows * kColumns * sizeof(T);
+    const std::size_t kOutputBytes = band_rows * kColumns * sizeof(T);
+    DevicePool& pool = DevicePool::Instance();
+    DevicePool::Block staging_block =
+      pool.Acquire(queue_, kInputBytes, sycl::usm::alloc::host);
+    DevicePool::Block input_block = pool.Acquire(queue_, kInputBytes);
+    DevicePool::Block output_block = pool.Acquire(queue_, kOutputBytes);
+    T* staging = staging_block.Get<T>();
+    const T* input = input_block.Get<T>();
+    T* output = output_block.Get<T>();
+
+    {
+      Trace::Scope trace_scope{"pack", kInputBytes};
+      FitsUtils::PackRows(source, kPitch, kPadding, kFirstInputRow,
+                          kInputRows, kColumns, staging);
+    }
+    auto upload = queue_.memcpy(input_block.Get<T>(), staging, kInputBytes);
     // Command Group Submission
-    queue.submit([&](sycl::handler& handler) {
-      sycl::accessor image_accessor{image_buffer, handler, sycl::read_only};
-      sycl::accessor output_accessor{output_buffer, handler, sycl::write_only};
-      sycl::accessor sel_accessor{sel_buffer, handler, sycl::read_only};
+    auto erosion = queue_.submit([&](sycl::handler& handler) {
+      handler.depends_on(upload);
+      handler.use_kernel_bundle(kernel_bundle);
       auto tile = sycl::local_accessor<T, 2>(tile_range, handler);
 
-      handler.parallel_for(nd_range, [=](sycl::nd_item<2> item) {
+      handler.parallel_for<ErodeKernel<T>>(nd_range,
+          [=](sycl::nd_item<2> item, sycl::kernel_handler kernel_handler) {
         auto global_id = item.get_global_id();
         auto group_id = item.get_group().get_group_id();
         auto local_id = item.get_local_id();
         auto global_group_offset = group_id * local_range;
-        
-        // Load tile
+
+        // Load tile, filling the padding around the image
         for (auto row = local_id[0]; row < tile_range[0]; row += local_range[0]) {
           for (auto column = local_id[1]; column < tile_range[1]; column += local_range[1]) {
-            tile[row][column] = image_accessor[global_group_offset + sycl::range(row, column)];
+            auto image_index = global_group_offset + sycl::range(row, column);
+            const long kInputRow =
+              static_cast<long>(image_index[0]) - kInputRowShift;
+            const long kInputColumn =
+              static_cast<long>(image_index[1]) - kPadding;
+            tile[row][column] = kInputRow >= 0 && kInputRow < kInputRows &&
+                                kInputColumn >= 0 && kInputColumn < kColumns ?
+                                input[kInputRow * kColumns + kInputColumn] :
+                                kFilling;
           }
         }
         sycl::group_barrier(item.get_group());
-        auto tile_index_origin = local_id + sel_offset;
+        if (global_id[0] >= band_range[0] || global_id[1] >= band_range[1]) {
+          return;
+        }
+        const long kTileRow = local_id[0] + padding_range[0];
+        const long kTileColumn = local_id[1] + padding_range[1];
 
         // Erode
-        T minimum = std::numeric_limits<T>::max();
-        for (int row = 0; row < sel_buffer_range[0]; ++row) {
-          for (int column = 0; column < sel_buffer_range[1]; ++column) {
-            auto tile_index = tile_index_origin + sycl::range(row, column);
-            if (sel_accessor[row][column] == static_cast<T>(1) &&
-                tile[tile_index] < minimum) {
-              minimum = tile[tile_index];
-            }
-          }
-        }
+        T minimum = ErodePixel<T>(kernel_handler, [&](int row, int column) {
+          return tile[kTileRow + row][kTileColumn + column];
+        });
         // Write output
-        output_accessor[global_id] = minimum;
+        output[global_id[0] * kColumns + global_id[1]] = minimum;
       });
     });
-    queue.wait_and_throw();
+    auto download = queue_.memcpy(staging, output, kOutputBytes, erosion);
+    // The blocks go back to the pool once nothing uses them
+    queue_.wait_and_throw();
+    {
+      Trace::Scope trace_scope{"unpack", kOutputBytes};
+      FitsUtils::UnpackRows(staging, kPitch, kPadding, first_row, band_rows,
+                            kColumns, destination);
+    }
+    Trace::AddDeviceCommands(queue_.get_device(), {
+      {"upload", upload, kInputBytes},
+      {"erode kernel", erosion, 0},
+      {"download", download, kOutputBytes}});
+  }
+  // Returns the device the engine runs on.
+  inline sycl::device GetDevice() const { return queue_.get_device(); }
+ private:
+  /**
+   * @brief Transforms a band of rows to binary with a threshold and erodes it
+   *  packed in words of bits.
+   * @param image FITS image to transform.
+   * @param kernel_bundle Kernels specialized for the structuring element.
+   * @param source Padded pixels to erode.
+   * @param destination Where the eroded rows of the band are written.
+   * @param first_row First row of the band, without padding.
+   * @param band_rows Amount of rows of the band.
+   * @param threshold_type Threshold calculated from the pixels of the band.
+   */
+  void OperateBinaryBand(TemplatedFitsImage<T>& image,
+                         typename SelKernelCache<T>::ExecutableBundle& kernel_bundle,
+                         const T* source, T* destination, long first_row,
+                         long band_rows, ThresholdType threshold_type) {
+    const long kTwicePadding = 2 * image.Padding();
+    { // Buffer scope
+    auto image_buffer_range =
+      sycl::range(band_rows + kTwicePadding, image.RowPitch());
+    auto output_buffer_range = sycl::range(band_rows, image.RowPitch());
+    auto image_buffer = sycl::buffer{source + first_row * image.RowPitch(),
+                                     image_buffer_range};
+    image_buffer.set_final_data(nullptr);
+    // Threshold from the pixels already on the device
+    T threshold{0};
+    if (threshold_type == ThresholdType::MEDIAN) {
+      threshold = FitsUtils::ThresholdValue<T>(DeviceStatistics::Median<T>(
+        queue_, image_buffer, image.Padding(), band_rows, image.Columns()));
+    } else if (threshold_type == ThresholdType::MEAN) {
+      threshold = FitsUtils::ThresholdValue<T>(DeviceStatistics::Mean<T>(
+        queue_, image_buffer, image.Padding(), band_rows, image.Columns()));
+    }
+    // Only the band rows, initialized from the destination so its padding
+    // columns survive the copy back
+    auto output_buffer = sycl::buffer{
+      destination + (first_row + image.Padding()) * image.RowPitch(),
+      output_buffer_range};
+    BinaryErosion::Erode<T>(queue_, kernel_bundle, image_buffer, output_buffer,
+                            image.Padding(), band_rows, image.Columns(),
+                            threshold);
+    queue_.wait_and_throw();
     }
   }
+
+  sycl::queue queue_;
+  SelKernelCache<T> kernel_cache_;
 };
 
 /**
@@ -0,0 +1,59 @@
+/**
+ * @brief FitsBatch class that processes every plane of a FITS file, the
+ *  planes of the cubes and the images of every extension.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class MorphologyChain;
+
+/**
+ * @brief Finds the two-dimensional planes of a FITS file and transforms all of
+ *  them into a copy of the file. Tables and empty HDUs are copied unchanged.
+ */
+class FitsBatch {
+ public:
+  /**
+   * @brief Finds the image planes of the file. Throws an exception if an
+   *  image HDU is neither two nor three-dimensional.
+   * @param file_name The name of the FITS file.
+   */
+  explicit FitsBatch(const std::string& file_name);
+  // Returns the amount of planes of the file.
+  inline long Planes() const { return static_cast<long>(planes_.size()); }
+  /**
+   * @brief Transforms every plane and writes them into the output file, with
+   *  the same HDUs as the input. Planes with the same pixel type share the
+   *  chain of operations and its structuring elements, so the device context
+   *  and the specialized kernels are reused.
+   * @param new_chain Gives the chain of operations for a CFITSIO data type,
+   *  which may be shared with other batches.
+   * @param output_file_name Output FITS file, overwritten if it exists.
+   * @param plane_threads Amount of planes processed concurrently.
+   * @param io_threads Threads that load each plane.
+   */
+  void Apply(const std::function<std::shared_ptr<MorphologyChain>(int)>&
+               new_chain,
+             const std::string& output_file_name, int plane_threads,
+             int io_threads);
+ private:
+  /**
+   * @brief A two-dimensional image, a plane of an HDU.
+   */
+  struct Plane {
+    int hdu;
+    long plane;
+  };
+
+  std::string file_name_;
+  std::vector<Plane> planes_;
+  // Image HDUs whose planes are transformed, the rest are copied
+  std::vector<bool> transformed_hdus_;
+};
@@ -6,10 +6,15 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstdlib>
+#include <future>
 #include <string>
 #include <fitsio.h>
 
 #include "morphology.h"
+#include "mapped_file.h"
+#include "trace.h"
 
 enum class OpeningMode {
   OPEN,
@@ -27,7 +32,7 @@ class StructuringElement;
 
 /**
  * @brief Manages FITS images
- * - Asumes there is only one HDU and the data image is two-dimensional.
+ * - Works with one HDU, and one plane of it if the data image is a cube.
  * - Any changes on the image are only applied to the internal representation,
  *   the original file is not modified unless explicitly indicated using
  *   WriteToOriginalFile().
@@ -50,21 +55,80 @@ class FitsImage {
   void CopyHeaderFrom(FitsImage& other_image);
   // Returns the data type of the image. Types defined in the CFITSIO library.
   inline int GetDataType() { return data_type_; }
+  // Returns true if the pixels are raw integers that BSCALE and BZERO are
+  // applied to lazily.
+  inline bool LazyScaling() const { return lazy_scaling_; }
+  // Returns the BSCALE value applied lazily, 1 if there is none.
+  inline double Scale() const { return scale_; }
+  // Returns the BZERO value applied lazily, 0 if there is none.
+  inline double Zero() const { return zero_; }
+  /**
+   * @brief Marks the pixels as physical values, for example once they are
+   *  transformed to binary. They are written without scaling.
+   */
+  inline void ClearScaling() {
+    scale_ = 1.0;
+    zero_ = 0.0;
+  }
+  /**
+   * @brief Sets the amount of threads that load the image, each one reads a
+   *  band of rows with its own CFITSIO handle. More than one requires a
+   *  reentrant build of CFITSIO, it is ignored otherwise.
+   * @param io_threads Amount of threads, at least 1.
+   */
+  inline void SetIoThreads(int io_threads) { io_threads_ = std::max(io_threads, 1); }
+  // Returns the rows of each tile of a tile-compressed image, 1 otherwise.
+  inline long TileRows() const { return tile_rows_; }
+  /**
+   * @brief Sets the compression of the FITS files written by WriteToFile().
+   * @param compression_type CFITSIO compression algorithm (RICE_1, GZIP_1,
+   *  GZIP_2 or HCOMPRESS_1), 0 to write uncompressed files.
+   */
+  inline void SetCompression(int compression_type) {
+    compression_type_ = compression_type;
+  }
   // Returns the status of the last operation.
   inline int GetStatus() const { return status_; }
   // Returns the amount of columns including padding.
   inline long PaddedColumns() const { return padded_dimensions_[0]; }
   // Returns the amount of rows including padding.
   inline long PaddedRows() const { return padded_dimensions_[1]; }
+  // Returns the distance, in elements, between two consecutive rows of the
+  // loaded image. The padded columns rounded up to whole cache lines.
+  inline long RowPitch() const { return row_pitch_; }
   // Returns the amount of columns of the actual image.
   inline long Columns() const { return dimensions_[0]; }
   // Returns the amount of rows of the actual image.
   inline long Rows() const { return dimensions_[1]; }
   // Returns the amount of padding around the image.
   inline long Padding() const { return padding_; }
+  // Returns the amount of planes of the image, 1 unless it is a cube.
+  inline long Planes() const { return planes_; }
+  // Returns the plane of the cube the image works with.
+  inline long Plane() const { return plane_; }
+  /**
+   * @brief Selects the plane of a cube (NAXIS = 3) the image is loaded from
+   *  and written to. Must be called before Load().
+   * @param plane Index of the plane, starting at 0.
+   */
+  void SelectPlane(long plane);
+  /**
+   * @brief Restricts the image to a region of the file, clipped to it, plus
+   *  a halo around it. Only the region and its halo are loaded and
+   *  transformed, only the region is written, as a cutout whose WCS
+   *  reference pixel is moved to its origin. Must be called before Load().
+   * @param first_column First column of the region, starting at 0.
+   * @param first_row First row of the region, starting at 0.
+   * @param columns Amount of columns of the region.
+   * @param rows Amount of rows of the region.
+   * @param halo Columns and rows read around the region, the SE size.
+   */
+  void SetRegion(long first_column, long first_row, long columns, long rows,
+                 long halo);
   // Returns the amount of pixels in the image.
   inline long TotalElements() const { return total_elements_; }
-  // Returns the amount of pixels in the image (with padding).
+  // Returns the amount of elements of the loaded image, with the padding and
+  // the end of the rows up to the row pitch.
   inline long PaddedTotalElements() const { return padded_total_elements_; }
   /**
    * @brief Reads the image from the original FITS file to the internal array.
@@ -76,17 +140,54 @@ class FitsImage {
   virtual void Load(long padding = 0,
                     PaddingType padding_type = PaddingType::CUSTOM,
                     double filling = 0.0) = 0;
+  /**
+   * @brief Fills the padding of the loaded image again, for an operation
+   *  that needs a different padding value than the previous one.
+   * @param padding_type Determines the padding value.
+   * @param filling Padding value if padding_type is CUSTOM. Ignored otherwise.
+   */
+  virtual void Refill(PaddingType padding_type, double filling = 0.0) = 0;
   // Writes the internal image to the FITS file.
   inline void WriteToOriginalFile() { WriteImageData(fits_file_); }
   /**
-   * @brief Writes the internal image to a new FITS file.
+   * @brief Writes the internal image to a new FITS file. Plain files are
+   *  written by the threads set with SetIoThreads(), each one encodes a band
+   *  of rows to big-endian and writes it with large sequential writes.
+   *  Files are tile-compressed if SetCompression() was called.
    * @param file_name Output file name.
    */
   void WriteToFile(std::string file_name);
-  // Calculates the median value of the original image.
+  /**
+   * @brief Writes the internal image into the current HDU of a FITS file,
+   *  whose header is a copy of the original one, at the selected plane.
+   * @param fits_file FITS file pointer.
+   */
+  void WriteToHdu(fitsfile* fits_file);
+  /**
+   * @brief Writes the internal image to a new FITS file on a background
+   *  thread. The image must not be modified or destroyed until it finishes.
+   * @param file_name Output file name.
+   * @returns Future that is ready once the file is written, and rethrows the
+   *  errors of the write.
+   */
+  std::future<void> WriteToFileAsync(std::string file_name);
+  /**
+   * @brief Creates a new FITS file with the header of this image, ready to
+   *  receive the image data. Is the user's responsibility to close it.
+   * @param file_name Output file name, overwritten if it exists.
+   * @returns The created FITS file pointer.
+   */
+  fitsfile* CreateCopy(std::string file_name);
+  // Calculates the median value of the loaded image, without reading the file.
   virtual double CalculateMedian() = 0;
-  // Calculates the mean value of the original image.
+  // Calculates the mean value of the loaded image, without reading the file.
   virtual double CalculateMean() = 0;
+  /**
+   * @brief Transforms the loaded image to binary: the pixels above the
+   *  threshold become 1 and the rest 0. The padding is not modified.
+   * @param threshold Threshold value.
+   */
+  virtual void Binarize(double threshold) = 0;
   /**
    * @brief Sets the morphology operation strategy.
    * @param operation The morphology operation to set.
@@ -97,25 +198,99 @@ class FitsImage {
    *  element.
    * @param sel Structuring Element to apply the operation with.
    */
-  inline void ApplyMorphology(StructuringElement* sel) { morphology_->Operate(this, sel); }
+  inline void ApplyMorphology(StructuringElement* sel) {
+    Trace::Scope scope{"operate"};
+    morphology_->Operate(this, sel);
+  }
  protected:
   /**
    * @brief Writes only the image data into the given FITS file.
    * @param fits_file FITS file pointer.
    */
   virtual void WriteImageData(fitsfile* fits_file) = 0;
+  /**
+   * @brief Writes the image data encoded as in a FITS file, bypassing
+   *  CFITSIO.
+   * @param file_descriptor Output file, open for writing.
+   * @param data_start Offset of the data unit in the file.
+   */
+  virtual void WriteEncodedData(int file_descriptor, long long data_start) = 0;
+  /**
+   * @brief Maps the data unit of the image if it is stored uncompressed in a
+   *  regular file and its pixels only need to be decoded from big-endian.
+   * @param mapping Mapping of the file, replaced.
+   * @returns The first byte of the data unit, nullptr if it cannot be mapped.
+   */
+  const unsigned char* MapDataUnit(MappedFile& mapping);
+  /**
+   * @brief Opens another CFITSIO handle on the HDU of the image, with the
+   *  same scaling. Is the user's responsibility to close it.
+   * @returns The FITS file pointer.
+   */
+  fitsfile* OpenHandle();
+  /**
+   * @brief Prepares a copy of the header to receive the pixels as they are
+   *  stored, raw if they are scaled lazily, with the shape of the cutout.
+   * @param fits_file FITS file pointer, at the copied HDU.
+   * @param status CFITSIO status.
+   */
+  void PrepareOutput(fitsfile* fits_file, int& status);
+  // Returns the size of the pixels written to the output, the cutout.
+  inline std::size_t OutputBytes() const {
+    return cutout_dimensions_[0] * cutout_dimensions_[1] * (std::abs(bitpix_) / 8);
+  }
+  // Returns the offset, in pixels, of the selected plane in the data unit.
+  inline long PlaneOffset() const {
+    return plane_ * file_dimensions_[0] * file_dimensions_[1];
+  }
+  /**
+   * @brief Writes the internal image tile-compressed, compressing an
+   *  uncompressed copy kept in memory.
+   * @param file_name Output file name.
+   */
+  void WriteCompressed(const std::string& file_name);
 
   static constexpr int kAmountOfAxis = 2;
+  // Size of the FITS blocks, every unit is padded up to a whole block.
+  static constexpr long long kFitsBlock = 2880;
+  // Alignment, in bytes, of the loaded image and of each of its rows.
+  static constexpr std::size_t kRowAlignment = 64;
+  // Bytes each writing thread encodes before every write.
+  static constexpr std::size_t kWriteChunkBytes = 16 << 20;
+  // Rows of the tiles HCOMPRESS accepts at least.
+  static constexpr long kHcompressMinimumRows = 4;
+  // Rows of the HCOMPRESS tiles when the input has no taller ones.
+  static constexpr long kHcompressTileRows = 16;
 
   fitsfile* fits_file_;
   Morphology* morphology_;
   int status_;
   int bitpix_;
   int data_type_;
+  bool lazy_scaling_{false};
+  // The pixels on disk only need to be decoded from big-endian
+  bool raw_pixels_{false};
+  int io_threads_{1};
+  // Tiles of a tile-compressed image, whole rows otherwise
+  long tile_rows_{1};
+  long tile_columns_{0};
+  int compression_type_{0};
+  double scale_{1.0};
+  double zero_{0.0};
   long dimensions_[kAmountOfAxis];
   long total_elements_;
+  long planes_{1};
+  // Image in the file, the loaded region is a part of it after SetRegion()
+  long file_dimensions_[kAmountOfAxis];
+  long region_start_[kAmountOfAxis]{0, 0};
+  // Part of the loaded region that is written, all of it without a region
+  long cutout_start_[kAmountOfAxis]{0, 0};
+  long cutout_dimensions_[kAmountOfAxis];
+  bool has_region_{false};
+  long plane_{0};
   long padding_;
   long padded_dimensions_[kAmountOfAxis];
+  long row_pitch_{0};
   long padded_total_elements_;
 };
 
@@ -7,6 +7,12 @@
 #pragma once
 
 #include <string>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <type_traits>
 
 namespace FitsUtils {
   /**
@@ -16,6 +22,22 @@ namespace FitsUtils {
    */
   bool FileExists(const std::string& file_name);
 
+  /**
+   * @brief Checks if CFITSIO writes the file name as a plain uncompressed
+   *  file, without extended file name syntax, drivers or compression.
+   * @param file_name File name to check.
+   * @returns True if it is a plain file, false otherwise.
+   */
+  bool IsPlainFileName(const std::string& file_name);
+
+  /**
+   * @brief Locks a mutex only if CFITSIO is not reentrant, so the threads
+   *  sharing it take turns calling CFITSIO instead of corrupting its state.
+   * @param mutex Mutex of the threads that call CFITSIO.
+   * @returns The lock, not owning the mutex if CFITSIO is reentrant.
+   */
+  std::unique_lock<std::mutex> LockUnlessReentrant(std::mutex& mutex);
+
   /**
    * @brief Calculates the ceiling of the quotient obtained by dividing the
    *  operands.
@@ -27,10 +49,161 @@ namespace FitsUtils {
     return (dividend + divisor - 1) / divisor;
   }
   /**
-   * @brief Transforms the bitpix into the data type equivalent.
+   * @brief Chooses the data type the pixels are stored with, the narrowest
+   *  one that holds them once BZERO is applied (BITPIX = 16 with
+   *  BZERO = 32768 is TUSHORT). Integer images scaled by a positive,
+   *  non-integer BSCALE or BZERO keep their raw integers, the caller has to
+   *  disable the scaling of CFITSIO and apply it when needed.
    *  Uses CFITSIO enums.
-   * @param bitpix Bitpix value to transform the value from.
+   * @param bitpix Bitpix value of the image.
+   * @param equivalent_bitpix Bitpix value once BSCALE and BZERO are applied.
+   * @param scale BSCALE value of the image.
    * @returns The data type equivalent.
    */
-  int GetDataType(int bitpix);
+  int GetDataType(int bitpix, int equivalent_bitpix, double scale);
+
+  // True if the host stores numbers in the same byte order as FITS files.
+  constexpr bool kBigEndianHost{__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__};
+
+  // Unsigned integer with the size of the pixel type.
+  template<typename T>
+  using PixelBits = std::conditional_t<sizeof(T) == 1, std::uint8_t,
+                    std::conditional_t<sizeof(T) == 2, std::uint16_t,
+                    std::conditional_t<sizeof(T) == 4, std::uint32_t,
+                                                       std::uint64_t>>>;
+
+  /**
+   * @brief Swaps the bytes of a pixel between the FITS and the host order.
+   * @param bits Bits of the pixel.
+   * @returns The swapped bits.
+   */
+  template<typename Bits>
+  inline Bits SwapBytes(Bits bits) {
+    if constexpr (!kBigEndianHost && sizeof(Bits) == 2) {
+      return __builtin_bswap16(bits);
+    } else if constexpr (!kBigEndianHost && sizeof(Bits) == 4) {
+      return __builtin_bswap32(bits);
+    } else if constexpr (!kBigEndianHost && sizeof(Bits) == 8) {
+      return __builtin_bswap64(bits);
+    } else {
+      return bits;
+    }
+  }
+
+  /**
+   * @brief Gives the bits flipped to apply the offset BZERO of the unsigned
+   *  (or signed 8-bit) integers, the sign bit.
+   * @param flip_sign False if no bits are flipped.
+   * @returns The bits to flip.
+   */
+  template<typename T>
+  inline PixelBits<T> SignMask(bool flip_sign) {
+    return flip_sign ? static_cast<PixelBits<T>>(
+                         PixelBits<T>{1} << (sizeof(T) * 8 - 1)) :
+                       PixelBits<T>{0};
+  }
+
+  /**
+   * @brief Decodes big-endian FITS pixels into host pixels. The loop has no
+   *  dependencies between pixels, so the compiler vectorizes it into byte
+   *  shuffles.
+   * @param source Pixels as stored in the FITS file.
+   * @param destination Where the decoded pixels are stored.
+   * @param amount Amount of pixels to decode.
+   * @param flip_sign Flips the sign bit, the offset BZERO of the unsigned
+   *  (or signed 8-bit) integers.
+   */
+  template<typename T>
+  void DecodeBigEndian(const unsigned char* source, T* destination,
+                       long amount, bool flip_sign) {
+    const PixelBits<T> kSign{SignMask<T>(flip_sign)};
+    for (long index{0}; index < amount; ++index) {
+      PixelBits<T> bits;
+      std::memcpy(&bits, source + index * sizeof(T), sizeof(T));
+      bits = SwapBytes(bits) ^ kSign;
+      std::memcpy(destination + index, &bits, sizeof(T));
+    }
+  }
+
+  /**
+   * @brief Encodes host pixels into big-endian FITS pixels, the inverse of
+   *  DecodeBigEndian().
+   * @param source Host pixels.
+   * @param destination Where the pixels are stored as in a FITS file.
+   * @param amount Amount of pixels to encode.
+   * @param flip_sign Flips the sign bit, the offset BZERO of the unsigned
+   *  (or signed 8-bit) integers.
+   */
+  template<typename T>
+  void EncodeBigEndian(const T* source, unsigned char* destination,
+                       long amount, bool flip_sign) {
+    const PixelBits<T> kSign{SignMask<T>(flip_sign)};
+    for (long index{0}; index < amount; ++index) {
+      PixelBits<T> bits;
+      std::memcpy(&bits, source + index, sizeof(T));
+      bits = SwapBytes(static_cast<PixelBits<T>>(bits ^ kSign));
+      std::memcpy(destination + index * sizeof(T), &bits, sizeof(T));
+    }
+  }
+
+  /**
+   * @brief Copies rows of a padded image without their padding, one after
+   *  another, such as into the staging memory of a device.
+   * @param padded Padded image, with `padding` rows and columns around it.
+   * @param row_pitch Elements of each padded row.
+   * @param padding Padding of the image.
+   * @param first_row First row to copy, without padding.
+   * @param rows Amount of rows to copy.
+   * @param columns Columns of the image, without padding.
+   * @param destination Where the `rows * columns` pixels are stored.
+   */
+  template<typename T>
+  void PackRows(const T* padded, long row_pitch, long padding, long first_row,
+                long rows, long columns, T* destination) {
+    for (long row{0}; row < rows; ++row) {
+      std::memcpy(destination + row * columns,
+                  padded + (first_row + row + padding) * row_pitch + padding,
+                  columns * sizeof(T));
+    }
+  }
+
+  /**
+   * @brief Copies unpadded rows into a padded image, the inverse of
+   *  PackRows(). The padding is not modified.
+   * @param source Rows of `columns` pixels, one after another.
+   * @param row_pitch Elements of each padded row.
+   * @param padding Padding of the image.
+   * @param first_row First row to copy into, without padding.
+   * @param rows Amount of rows to copy.
+   * @param columns Columns of the image, without padding.
+   * @param padded Padded image.
+   */
+  template<typename T>
+  void UnpackRows(const T* source, long row_pitch, long padding,
+                  long first_row, long rows, long columns, T* padded) {
+    for (long row{0}; row < rows; ++row) {
+      std::memcpy(padded + (first_row + row + padding) * row_pitch + padding,
+                  source + row * columns, columns * sizeof(T));
+    }
+  }
+
+  /**
+   * @brief Converts a binarization threshold into the pixel type, so that
+   *  `pixel > ThresholdValue<T>(threshold)` is the same as
+   *  `pixel > threshold` for any pixel.
+   * @param threshold Threshold value.
+   * @returns The threshold in the pixel type.
+   */
+  template<typename T>
+  T ThresholdValue(double threshold) {
+    if constexpr (std::is_integral_v<T>) {
+      threshold = std::floor(threshold);
+      if (threshold < static_cast<double>(std::numeric_limits<T>::lowest())) {
+        return std::numeric_limits<T>::lowest();
+      } else if (threshold > static_cast<double>(std::numeric_limits<T>::max())) {
+        return std::numeric_limits<T>::max();
+      }
+    }
+    return static_cast<T>(threshold);
+  }
 }
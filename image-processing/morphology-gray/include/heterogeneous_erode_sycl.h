@@ -0,0 +1,208 @@
+/**
+ * @brief HeterogeneousErode class which splits a morphological erosion among
+ *  every SYCL device and the host CPU.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#pragma once
+
+#include "morphology.h"
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <sycl/sycl.hpp>
+
+#include "templated_fits_image.h"
+#include "templated_structuring_element.h"
+#include "erode_sycl.h"
+#include "erode_region.h"
+#include "trace_sycl.h"
+
+/**
+ * @brief Performs a morphological erosion splitting the image into bands of
+ *  rows. Each band is eroded concurrently by a different engine:
+ * - One per CPU sub-device, partitioned by affinity domain (NUMA nodes).
+ * - One per GPU or accelerator.
+ * - The native CPU engine.
+ * The bands are sized from the throughput every engine achieved on the
+ * previous operations.
+ */
+template<typename T>
+class HeterogeneousErode: public Morphology {
+ public:
+  HeterogeneousErode() {
+    for (sycl::queue& queue : GetQueues()) {
+      device_engines_.push_back(std::make_unique<Erode<T>>(queue));
+    }
+    // Every engine starts with the same share, the last one is the host
+    throughputs_.assign(device_engines_.size() + 1, 1.0);
+  }
+  ~HeterogeneousErode() override {}
+  /**
+   * @brief Builds the kernels specialized for the structuring element on
+   *  every device at the same time.
+   * @param operation_sel Structuring element the operation will use.
+   */
+  void Prepare(StructuringElement* operation_sel) override {
+    std::vector<std::future<void>> builds;
+    for (auto& engine : device_engines_) {
+      Erode<T>* device_engine{engine.get()};
+      builds.push_back(std::async(std::launch::async, [=]() {
+        device_engine->Prepare(operation_sel);
+      }));
+    }
+    for (std::future<void>& build : builds) {
+      build.get();
+    }
+  }
+  /**
+   * @brief Performs a morphological erosion on the image with the structuring
+   *  element.
+   * @param image FITS image to transform.
+   * @param sel Structuring element for the operation.
+   */
+  void Operate(FitsImage* fits_image, StructuringElement* operation_sel) override {
+    TemplatedFitsImage<T>& image =
+      *dynamic_cast<TemplatedFitsImage<T>*>(fits_image);
+    TemplatedStructuringElement<T>& sel =
+      *dynamic_cast<TemplatedStructuringElement<T>*>(operation_sel);
+    // Each engine only sees its band, the threshold needs the whole image
+    ApplyThreshold(fits_image);
+    // Every band reads its halo from the image and writes the other buffer,
+    // which becomes the image
+    const T* source = image.GetData();
+    T* destination = image.GetScratch();
+    const long kPaddingOffset = image.Padding() * image.RowPitch() +
+                                image.Padding();
+    std::vector<long> band_rows{SplitRows(image.Rows())};
+    std::vector<double> band_times(band_rows.size(), 0.0);
+
+    std::vector<std::thread> workers;
+    long first_row{0};
+    for (std::size_t engine{0}; engine < band_rows.size(); ++engine) {
+      const long kFirstRow{first_row};
+      const long kBandRows{band_rows[engine]};
+      first_row += kBandRows;
+      if (kBandRows == 0) {
+        continue;
+      }
+      workers.emplace_back([&, engine, kFirstRow, kBandRows]() {
+        auto start_time = std::chrono::steady_clock::now();
+        if (engine < device_engines_.size()) {
+          device_engines_[engine]->OperateBand(image, sel, source, destination,
+                                               kFirstRow, kBandRows);
+        } else {
+          const long kOffset = kPaddingOffset + kFirstRow * image.RowPitch();
+          ErodeRegion(source + kOffset, destination + kOffset, kBandRows,
+                      image.Columns(), image.RowPitch(), sel);
+        }
+        auto end_time = std::chrono::steady_clock::now();
+        band_times[engine] =
+          std::chrono::duration<double>(end_time - start_time).count();
+      });
+    }
+    for (std::thread& worker : workers) {
+      worker.join();
+    }
+    image.SwapScratch();
+    UpdateThroughputs(band_rows, band_times);
+  }
+ private:
+  // Weight of the last measurement when updating the throughputs.
+  static constexpr double kThroughputSmoothing = 0.5;
+
+  /**
+   * @brief Finds the queues of every device to erode with. CPU devices are
+   *  partitioned into their NUMA sub-devices if possible.
+   * @returns The device queues.
+   */
+  static std::vector<sycl::queue> GetQueues() {
+    std::vector<sycl::queue> queues;
+    bool cpu_found{false};
+    for (const sycl::device& device : sycl::device::get_devices()) {
+      if (device.is_cpu()) {
+        // The same CPU can be listed by several backends
+        if (cpu_found) {
+          continue;
+        }
+        cpu_found = true;
+        try {
+          auto sub_devices = device.create_sub_devices<
+            sycl::info::partition_property::partition_by_affinity_domain>(
+              sycl::info::partition_affinity_domain::next_partitionable);
+          for (const sycl::device& sub_device : sub_devices) {
+            queues.emplace_back(sub_device, Trace::QueueProperties());
+          }
+        } catch (const sycl::exception&) {
+          // Not partitionable, use the whole CPU
+          queues.emplace_back(device, Trace::QueueProperties());
+        }
+      } else if (device.is_gpu() || device.is_accelerator()) {
+        queues.emplace_back(device, Trace::QueueProperties());
+      }
+    }
+    return queues;
+  }
+  /**
+   * @brief Splits the rows of the image proportionally to the throughput of
+   *  each engine.
+   * @param rows Amount of rows of the image.
+   * @returns The amount of rows of each engine's band.
+   */
+  std::vector<long> SplitRows(long rows) const {
+    double total_throughput{0};
+    for (double throughput : throughputs_) {
+      total_throughput += throughput;
+    }
+    std::vector<long> band_rows(throughputs_.size(), 0);
+    long assigned_rows{0};
+    for (std::size_t engine{0}; engine < throughputs_.size(); ++engine) {
+      band_rows[engine] = static_cast<long>(
+        rows * throughputs_[engine] / total_throughput);
+      assigned_rows += band_rows[engine];
+    }
+    // Rounding leftovers go to the fastest engine
+    auto fastest = std::max_element(throughputs_.begin(), throughputs_.end());
+    band_rows[fastest - throughputs_.begin()] += rows - assigned_rows;
+    return band_rows;
+  }
+  /**
+   * @brief Updates the throughput of each engine with the last measurements.
+   *  Engines without a band keep their previous throughput.
+   * @param band_rows Amount of rows each engine eroded.
+   * @param band_times Time each engine took, in seconds.
+   */
+  void UpdateThroughputs(const std::vector<long>& band_rows,
+                         const std::vector<double>& band_times) {
+    for (std::size_t engine{0}; engine < throughputs_.size(); ++engine) {
+      if (band_rows[engine] == 0 || band_times[engine] <= 0.0) {
+        continue;
+      }
+      double measured_throughput{band_rows[engine] / band_times[engine]};
+      throughputs_[engine] = !measured_ ? measured_throughput :
+        kThroughputSmoothing * measured_throughput +
+        (1.0 - kThroughputSmoothing) * throughputs_[engine];
+    }
+    measured_ = true;
+  }
+
+  std::vector<std::unique_ptr<Erode<T>>> device_engines_;
+  // Rows per second of each engine, the last one is the host
+  std::vector<double> throughputs_;
+  // Whether the throughputs come from an actual measurement
+  bool measured_{false};
+};
+
+/**
+ * @brief Creates a HeterogeneousErode instance using dynamic memory. Is the
+ *  user's responsibility to free the memory.
+ * @param data_type The type of data it operates with.
+ *  Uses CFITSIO data type enum.
+ * @returns A HeterogeneousErode object as its base class poiner.
+ */
+Morphology* NewHeterogeneousErode(int data_type);
@@ -0,0 +1,99 @@
+/**
+ * @brief JobServer class that transforms FITS files requested through a Unix
+ *  domain socket, keeping the engines warm between jobs.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include "bounded_queue.h"
+#include "chain_cache.h"
+#include "utils.h"
+
+/**
+ * @brief Listens on a Unix domain socket for jobs, one per line with the
+ *  fields of the command line separated by tabs:
+ *  `<fits_file> <se_file> <output_file> <operation> [threshold_type]`.
+ *  Each job is answered, in order, with `OK <seconds>` or `ERROR <message>`.
+ *  The line `shutdown` stops the server once the queued jobs are done.
+ *
+ *  The chains of operations, with their parsed SEs, device queues and
+ *  specialized kernels, are cached across jobs and reused while the SE files
+ *  are not modified. The device memory pool is shared by every job as well.
+ *  Without a reentrant CFITSIO the workers take turns to read and write the
+ *  files, overlapping only the operations.
+ */
+class JobServer {
+ public:
+  /**
+   * @brief Creates the server, without listening yet.
+   * @param socket_path Path of the socket, replaced if it exists.
+   * @param options Options applied to every job: I/O threads, compression
+   *  and heterogeneous mode.
+   * @param workers Jobs processed at once, 1 in heterogeneous mode.
+   * @param queue_capacity Jobs waiting at most, the clients wait when full.
+   */
+  JobServer(const std::string& socket_path, const Options& options,
+            int workers, std::size_t queue_capacity);
+  ~JobServer();
+  JobServer(const JobServer&) = delete;
+  JobServer& operator=(const JobServer&) = delete;
+  /**
+   * @brief Serves jobs until a shutdown request. Throws an exception if the
+   *  socket cannot be created.
+   */
+  void Run();
+ private:
+  /**
+   * @brief A requested job and the answer to its client.
+   */
+  struct Job {
+    std::string image_file_name;
+    std::string sel_file_name;
+    std::string output_file_name;
+    std::string operation;
+    ThresholdType threshold_type{ThresholdType::NONE};
+    std::promise<std::string> response;
+  };
+  /**
+   * @brief Reads the jobs of a connection and answers them.
+   * @param connection Socket of the connection.
+   */
+  void Serve(int connection);
+  // Takes queued jobs and runs them until the server stops.
+  void Work();
+  /**
+   * @brief Transforms a FITS file.
+   * @param job The job to run.
+   * @returns The answer to the client.
+   */
+  std::string RunJob(Job& job);
+  // Stops accepting connections and jobs.
+  void Stop();
+
+  std::string socket_path_;
+  Options options_;
+  int workers_;
+  int listener_{-1};
+  BoundedQueue<std::shared_ptr<Job>> queue_;
+  std::atomic<bool> stopping_{false};
+  ChainCache chains_;
+  // Makes the workers take turns with CFITSIO if it is not reentrant
+  std::mutex fits_mutex_;
+
+  std::mutex connections_mutex_;
+  // Connections being served, each by a detached thread
+  std::set<int> connections_;
+  // Notified when a connection is closed
+  std::condition_variable connections_closed_;
+};
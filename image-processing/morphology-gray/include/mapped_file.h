@@ -0,0 +1,42 @@
+/**
+ * @brief Mapped File class that maps a whole file into memory.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/**
+ * @brief Maps a file into memory for as long as the object lives. The mapping
+ *  is private: it can be written without modifying the file.
+ */
+class MappedFile {
+ public:
+  // Creates an empty mapping.
+  MappedFile(): data_{nullptr}, size_{0} {}
+  /**
+   * @brief Maps the whole file, read sequentially.
+   * @param file_name File to map.
+   */
+  explicit MappedFile(const std::string& file_name);
+  ~MappedFile() { Unmap(); }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+  // Gives a pointer to the first byte of the file.
+  inline unsigned char* Data() const { return data_; }
+  // Returns the size of the file in bytes.
+  inline std::size_t Size() const { return size_; }
+  // Returns true if no file is mapped.
+  inline bool Empty() const { return data_ == nullptr; }
+ private:
+  // Releases the mapping, if any.
+  void Unmap();
+
+  unsigned char* data_;
+  std::size_t size_;
+};
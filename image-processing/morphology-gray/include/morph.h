@@ -0,0 +1,61 @@
+/**
+ * @brief Public interface of libmorph, the morphological operations on images
+ *  already in memory, without CFITSIO nor file I/O.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#pragma once
+
+namespace Morph {
+  // Type of the pixels of an image in memory.
+  enum class PixelType {
+    UINT8,
+    INT8,
+    INT16,
+    UINT16,
+    INT32,
+    UINT32,
+    INT64,
+    FLOAT32,
+    FLOAT64
+  };
+
+  /**
+   * @brief Image owned by the caller. The rows may be separated by a stride
+   *  larger than the columns, such as a subarray of a bigger image.
+   */
+  struct ImageView {
+    void* data;
+    long rows;
+    long columns;
+    // Distance, in pixels, between the first pixels of two consecutive rows
+    long row_stride;
+    PixelType type;
+  };
+
+  /**
+   * @brief Structuring element owned by the caller.
+   */
+  struct SelDescriptor {
+    // Cells in row-major order, rows in the same order as the image rows in
+    // memory. Non-zero cells belong to the SE.
+    const unsigned char* mask;
+    long rows;
+    long columns;
+    long center_row;
+    long center_column;
+  };
+
+  /**
+   * @brief Erodes an image into another one of the same shape and type. The
+   *  pixels outside of the image do not take part in the erosion. Throws an
+   *  exception if the images or the SE are not valid.
+   * @param source Image to erode, only read.
+   * @param destination Where the eroded image is stored. Must not overlap
+   *  the source.
+   * @param sel Structuring element for the operation.
+   */
+  void Erode(const ImageView& source, const ImageView& destination,
+             const SelDescriptor& sel);
+}
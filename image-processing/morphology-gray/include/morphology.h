@@ -10,6 +10,13 @@
 class FitsImage;
 class StructuringElement;
 
+// Threshold used to transform the image to binary before the operation.
+enum class ThresholdType {
+  NONE,
+  MEDIAN,
+  MEAN
+};
+
 /**
  * @brief Represents a morphology operation.
  */
@@ -24,4 +31,28 @@ class Morphology {
    * @param sel Structuring element for the operation.
    */
   virtual void Operate(FitsImage* fits_image, StructuringElement* operation_sel) = 0;
+  /**
+   * @brief Readies the operation for a structuring element before the first
+   *  image, such as building the kernels specialized for it, so the first
+   *  image does not wait for them. Does nothing by default.
+   * @param operation_sel Structuring element the operation will use.
+   */
+  virtual void Prepare(StructuringElement* operation_sel) {}
+  /**
+   * @brief Sets the threshold to transform the image to binary before the
+   *  operation. The image is kept in grayscale with ThresholdType::NONE.
+   * @param threshold_type The threshold to use.
+   */
+  inline void SetThreshold(ThresholdType threshold_type) {
+    threshold_type_ = threshold_type;
+  }
+ protected:
+  /**
+   * @brief Transforms the loaded image to binary on the host, using the
+   *  threshold set with SetThreshold().
+   * @param fits_image FITS image to transform.
+   */
+  void ApplyThreshold(FitsImage* fits_image);
+
+  ThresholdType threshold_type_{ThresholdType::NONE};
 };
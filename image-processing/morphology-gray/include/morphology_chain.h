@@ -0,0 +1,70 @@
+/**
+ * @brief MorphologyChain class that applies several morphology operations one
+ *  after another, each with its own structuring element.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#pragma once
+
+#include "morphology.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "structuring_element.h"
+
+enum class PaddingType;
+
+/**
+ * @brief Represents a chain of morphology operations that transform the loaded
+ *  image in memory. The image and its scratch buffer are reused by every
+ *  step, only the padding is filled again before each one.
+ */
+class MorphologyChain: public Morphology {
+ public:
+  MorphologyChain() {}
+  ~MorphologyChain() override {}
+  /**
+   * @brief Appends an operation to the chain, which takes ownership of it,
+   *  and readies it for its SE.
+   * @param operation The morphology operation.
+   * @param sel Structuring element of the operation.
+   * @param filling Padding type the operation needs.
+   * @param name Name of the step in the traces and counters.
+   */
+  void AddStep(Morphology* operation, StructuringElement* sel,
+               PaddingType filling, const std::string& name);
+  /**
+   * @brief Applies every operation of the chain in order.
+   * @param fits_image FITS image to transform, loaded with Padding().
+   * @param operation_sel Ignored, each step has its own SE.
+   */
+  void Operate(FitsImage* fits_image, StructuringElement* operation_sel) override;
+  // Returns the amount of operations of the chain.
+  inline long Steps() const { return static_cast<long>(steps_.size()); }
+  // Returns the padding the image must be loaded with, the largest SE size.
+  long Padding() const;
+  /**
+   * @brief Calculates how far the result of a pixel reaches in the original
+   *  image, the sum of the SE sizes of every step. It is the halo needed to
+   *  transform a region with the whole chain.
+   * @returns The halo of the chain.
+   */
+  long Halo() const;
+  // Returns the padding type of the first operation.
+  PaddingType Filling() const;
+ private:
+  /**
+   * @brief An operation of the chain with its own structuring element.
+   */
+  struct Step {
+    std::unique_ptr<Morphology> operation;
+    std::unique_ptr<StructuringElement> sel;
+    PaddingType filling;
+    std::string name;
+  };
+
+  std::vector<Step> steps_;
+};
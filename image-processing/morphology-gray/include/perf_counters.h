@@ -0,0 +1,117 @@
+/**
+ * @brief Hardware performance counters of the operations, read with
+ *  perf_event_open on Linux.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace Perf {
+  /**
+   * @brief Counters of a group. VECTOR is a raw, CPU-specific event chosen by
+   *  the user, such as the retired SIMD instructions of the CPU.
+   */
+  enum Counter {
+    CYCLES,
+    INSTRUCTIONS,
+    LLC_MISSES,
+    VECTOR,
+    kCounters
+  };
+
+  // Bytes brought by each last level cache miss.
+  constexpr double kCacheLineBytes = 64.0;
+
+  // True while the counters are collected, read by every scope.
+  inline std::atomic<bool> enabled{false};
+
+  // Tells if the counters are being collected.
+  inline bool Enabled() { return enabled.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief Starts collecting counters.
+   * @param vector_event Raw perf event (PERF_TYPE_RAW config) counted as
+   *  VECTOR, 0 to not count it.
+   */
+  void Enable(std::uint64_t vector_event = 0);
+
+  /**
+   * @brief Values of the counters of a phase, added up over its runs.
+   */
+  struct Counts {
+    std::uint64_t values[kCounters] = {0, 0, 0, 0};
+    // Counters the kernel could not open or schedule are not available
+    bool available[kCounters] = {false, false, false, false};
+    long runs{0};
+    // Pixels processed by the runs
+    double pixels{0};
+  };
+
+  /**
+   * @brief Counters of the calling thread and the threads it creates, opened
+   *  as a group so they are scheduled together. Counters that cannot be
+   *  opened (no PMU, perf_event_paranoid, virtual machines) are skipped.
+   */
+  class CounterGroup {
+   public:
+    CounterGroup();
+    ~CounterGroup();
+    CounterGroup(const CounterGroup&) = delete;
+    CounterGroup& operator=(const CounterGroup&) = delete;
+    // Resets and starts the counters.
+    void Start();
+    /**
+     * @brief Stops the counters and reads them. Counters multiplexed with
+     *  other events are scaled to the whole time they were enabled.
+     * @param counts Where the values are added.
+     */
+    void Stop(Counts& counts);
+   private:
+    int descriptors_[kCounters];
+  };
+
+  /**
+   * @brief Counts the hardware events from its creation to its destruction
+   *  and adds them to a phase. Only reads a flag when disabled.
+   */
+  class Scope {
+   public:
+    /**
+     * @param phase Name of the phase, must outlive the scope. Nothing is
+     *  counted if it is nullptr.
+     * @param pixels Pixels the phase processes.
+     */
+    Scope(const char* phase, double pixels);
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+    ~Scope();
+   private:
+    const char* phase_;
+    double pixels_;
+    CounterGroup* group_;
+  };
+
+  /**
+   * @brief Returns the counters added up for a phase.
+   * @param phase Name of the phase.
+   * @returns The counts, without any run if the phase was not counted.
+   */
+  Counts PhaseCounts(const std::string& phase);
+
+  /**
+   * @brief Derives the metrics of a phase: IPC, instructions per pixel, bytes
+   *  per pixel brought from memory (LLC misses of 64 bytes lines) and vector
+   *  instructions per pixel. Unavailable counters are shown as such.
+   * @param counts Counters of the phase.
+   * @returns The metrics in a line.
+   */
+  std::string Metrics(const Counts& counts);
+
+  // Returns one line of metrics per phase.
+  std::string Summary();
+}
@@ -0,0 +1,139 @@
+/**
+ * @brief Reconstruct class which implements the morphological opening by
+ *  reconstruction.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#pragma once
+
+#include "morphology.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "templated_fits_image.h"
+#include "templated_structuring_element.h"
+#include "erode_region.h"
+
+/**
+ * @brief Performs a morphological opening by reconstruction: the image eroded
+ *  with the structuring element is the marker, which is dilated with the
+ *  same SE under the original image until it no longer changes.
+ */
+template<typename T>
+class Reconstruct: public Morphology {
+ public:
+  Reconstruct() {}
+  ~Reconstruct() override {}
+  /**
+   * @brief Performs a morphological opening by reconstruction on the image
+   *  with the structuring element.
+   * @param image FITS image to transform.
+   * @param sel Structuring element for the operation.
+   */
+  void Operate(FitsImage* fits_image, StructuringElement* operation_sel) override {
+    TemplatedFitsImage<T>& image =
+      *dynamic_cast<TemplatedFitsImage<T>*>(fits_image);
+    TemplatedStructuringElement<T>& sel =
+      *dynamic_cast<TemplatedStructuringElement<T>*>(operation_sel);
+    ApplyThreshold(fits_image);
+    T* marker = image.GetData();
+    T* mask = image.GetScratch();
+    std::copy(marker, marker + image.PaddedTotalElements(), mask);
+    const long kPitch = image.RowPitch();
+    const long kOrigin = image.Padding() * kPitch + image.Padding();
+    ErodeRegion(mask + kOrigin, marker + kOrigin, image.Rows(),
+                image.Columns(), kPitch, sel);
+    // The marker must lie under the mask and its padding must be neutral for
+    // the dilation
+    const T kLowest = std::numeric_limits<T>::lowest();
+    for (long row{0}; row < image.PaddedRows(); ++row) {
+      T* marker_row = marker + row * kPitch;
+      if (row < image.Padding() || row >= image.Padding() + image.Rows()) {
+        std::fill(marker_row, marker_row + kPitch, kLowest);
+        continue;
+      }
+      const T* mask_row = mask + row * kPitch;
+      for (long column{image.Padding()};
+          column < image.Padding() + image.Columns();
+          ++column) {
+        marker_row[column] = std::min(marker_row[column], mask_row[column]);
+      }
+      std::fill(marker_row, marker_row + image.Padding(), kLowest);
+      std::fill(marker_row + image.Padding() + image.Columns(),
+                marker_row + kPitch, kLowest);
+    }
+    // Forward and backward scans in place until the marker is stable
+    const std::vector<long> kOffsets{DilationOffsets(sel, kPitch)};
+    bool changed{true};
+    while (changed) {
+      changed = false;
+      for (long row{0}; row < image.Rows(); ++row) {
+        for (long column{0}; column < image.Columns(); ++column) {
+          changed |= Propagate(marker, mask, kOffsets,
+                               kOrigin + row * kPitch + column);
+        }
+      }
+      for (long row{image.Rows() - 1}; row >= 0; --row) {
+        for (long column{image.Columns() - 1}; column >= 0; --column) {
+          changed |= Propagate(marker, mask, kOffsets,
+                               kOrigin + row * kPitch + column);
+        }
+      }
+    }
+  }
+ private:
+  /**
+   * @brief Calculates the offsets of the SE reflected around its origin, the
+   *  neighbours a pixel is dilated from.
+   * @param sel Structuring element for the operation.
+   * @param pitch Distance, in elements, between two consecutive rows.
+   * @returns The offsets.
+   */
+  static std::vector<long> DilationOffsets(TemplatedStructuringElement<T>& sel,
+                                           long pitch) {
+    std::vector<long> offsets;
+    const T* sel_data = sel.GetData();
+    for (long row{0}; row < sel.Rows(); ++row) {
+      for (long column{0}; column < sel.Columns(); ++column) {
+        if (sel_data[row * sel.Columns() + column] == 1) {
+          offsets.push_back((sel.CenterRow() - row) * pitch +
+                            sel.CenterColumn() - column);
+        }
+      }
+    }
+    return offsets;
+  }
+  /**
+   * @brief Dilates a pixel of the marker under the mask.
+   * @param marker Padded marker image.
+   * @param mask Padded mask image.
+   * @param offsets Neighbours to dilate from.
+   * @param pixel Index of the pixel.
+   * @returns True if the pixel changed, false otherwise.
+   */
+  static bool Propagate(T* marker, const T* mask,
+                        const std::vector<long>& offsets, long pixel) {
+    T maximum = marker[pixel];
+    for (long offset : offsets) {
+      maximum = std::max(maximum, marker[pixel + offset]);
+    }
+    maximum = std::min(maximum, mask[pixel]);
+    if (maximum > marker[pixel]) {
+      marker[pixel] = maximum;
+      return true;
+    }
+    return false;
+  }
+};
+
+/**
+ * @brief Creates a Reconstruct instance using dynamic memory. Is the user's
+ *  responsibility to free the memory.
+ * @param data_type The type of data it operates with.
+ *  Uses CFITSIO data type enum.
+ * @returns A Reconstruct object as its base class poiner.
+ */
+Morphology* NewReconstruct(int data_type);
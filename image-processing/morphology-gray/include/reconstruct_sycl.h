@@ -0,0 +1,234 @@
+/**
+ * @brief Reconstruct class which implements the morphological opening by
+ *  reconstruction.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#pragma once
+
+#include "morphology.h"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <sycl/sycl.hpp>
+
+#include "templated_fits_image.h"
+#include "templated_structuring_element.h"
+#include "fits_utils.h"
+#include "sel_specialization_sycl.h"
+#include "trace_sycl.h"
+
+template<typename T> class MarkerKernel;
+template<typename T> class ReconstructKernel;
+template<typename T> class ReconstructCopyKernel;
+
+/**
+ * @brief Performs a morphological opening by reconstruction: the image eroded
+ *  with the structuring element is the marker, which is dilated with the
+ *  same SE under the original image until it no longer changes.
+ *  Every round propagates the marker inside each work-group tile until the
+ *  tile is stable, so the global rounds only carry it across tiles. The
+ *  marker never leaves the device, the host only reads a changed flag after
+ *  each round.
+ */
+template<typename T>
+class Reconstruct: public Morphology {
+ public:
+  Reconstruct(): Reconstruct{sycl::queue{sycl::gpu_selector_v,
+                                          Trace::QueueProperties()}} {}
+  /**
+   * @brief Creates a reconstruction engine that runs on the given queue.
+   * @param queue Queue of the device to reconstruct with.
+   */
+  explicit Reconstruct(sycl::queue queue):
+      queue_{queue},
+      kernel_cache_{queue_, {sycl::get_kernel_id<MarkerKernel<T>>(),
+                             sycl::get_kernel_id<ReconstructKernel<T>>()}} {}
+  ~Reconstruct() override {}
+  /**
+   * @brief Builds the kernels specialized for the structuring element.
+   * @param operation_sel Structuring element the operation will use.
+   */
+  void Prepare(StructuringElement* operation_sel) override {
+    Trace::Scope trace_scope{"build kernels"};
+    kernel_cache_.Get(
+      *dynamic_cast<TemplatedStructuringElement<T>*>(operation_sel));
+  }
+  /**
+   * @brief Performs a morphological opening by reconstruction on the image
+   *  with the structuring element.
+   * @param image FITS image to transform.
+   * @param sel Structuring element for the operation.
+   */
+  void Operate(FitsImage* fits_image, StructuringElement* operation_sel) override {
+    TemplatedFitsImage<T>& image =
+      *dynamic_cast<TemplatedFitsImage<T>*>(fits_image);
+    TemplatedStructuringElement<T>& sel =
+      *dynamic_cast<TemplatedStructuringElement<T>*>(operation_sel);
+    ApplyThreshold(fits_image);
+    auto& kernel_bundle = kernel_cache_.Get(sel);
+    const long kPadding{image.Padding()};
+    const long kRows{image.Rows()};
+    const long kColumns{image.Columns()};
+    const T kLowest = std::numeric_limits<T>::lowest();
+
+    { // Buffer scope
+    // CG Ranges
+    const auto kLocalRange = sycl::range(kGroupSize, kGroupSize);
+    const auto kGlobalRange = sycl::range(
+      FitsUtils::DivisionCeiling(kRows, kGroupSize) * kGroupSize,
+      FitsUtils::DivisionCeiling(kColumns, kGroupSize) * kGroupSize);
+    const auto kNdRange = sycl::nd_range(kGlobalRange, kLocalRange);
+    const auto kImageRange = sycl::range(kRows, kColumns);
+    // Buffer Ranges
+    const auto kPaddedRange = sycl::range(image.PaddedRows(), image.RowPitch());
+    const auto kOutputRange = sycl::range(kRows, image.RowPitch());
+    const auto kTileRange = kLocalRange + sycl::range(2 * kPadding, 2 * kPadding);
+    // Buffers
+    auto mask_buffer = sycl::buffer{image.GetData(), kPaddedRange};
+    mask_buffer.set_final_data(nullptr);
+    sycl::buffer<T, 2> marker_buffer{kPaddedRange};
+    sycl::buffer<T, 2> next_marker_buffer{kPaddedRange};
+    sycl::buffer<int, 1> changed_buffer{sycl::range(1)};
+    // Only the image rows, initialized from the image so the padding columns
+    // survive the copy back
+    auto output_buffer = sycl::buffer{
+      image.GetData() + kPadding * image.RowPitch(), kOutputRange};
+
+    // The padding of both markers is neutral for the dilation
+    for (sycl::buffer<T, 2>* buffer : {&marker_buffer, &next_marker_buffer}) {
+      queue_.submit([&](sycl::handler& handler) {
+        sycl::accessor marker{*buffer, handler, sycl::write_only, sycl::no_init};
+        handler.fill(marker, kLowest);
+      });
+    }
+    // Marker, the eroded image kept under the mask
+    queue_.submit([&](sycl::handler& handler) {
+      handler.use_kernel_bundle(kernel_bundle);
+      sycl::accessor mask{mask_buffer, handler, sycl::read_only};
+      sycl::accessor marker{marker_buffer, handler, sycl::write_only};
+      handler.parallel_for<MarkerKernel<T>>(kImageRange,
+          [=](sycl::item<2> item, sycl::kernel_handler kernel_handler) {
+        const long kRow = item[0] + kPadding;
+        const long kColumn = item[1] + kPadding;
+        T minimum = ErodePixel<T>(kernel_handler, [&](int row, int column) {
+          return mask[kRow + row][kColumn + column];
+        });
+        marker[kRow][kColumn] = std::min(minimum, mask[kRow][kColumn]);
+      });
+    });
+
+    // Rounds until no work-group changes its tile
+    bool changed{true};
+    while (changed) {
+      {
+        sycl::host_accessor changed_flag{changed_buffer, sycl::write_only};
+        changed_flag[0] = 0;
+      }
+      queue_.submit([&](sycl::handler& handler) {
+        handler.use_kernel_bundle(kernel_bundle);
+        sycl::accessor mask{mask_buffer, handler, sycl::read_only};
+        sycl::accessor marker{marker_buffer, handler, sycl::read_only};
+        sycl::accessor next_marker{next_marker_buffer, handler, sycl::write_only};
+        sycl::accessor changed_flag{changed_buffer, handler, sycl::read_write};
+        auto tile = sycl::local_accessor<T, 2>(kTileRange, handler);
+
+        handler.parallel_for<ReconstructKernel<T>>(kNdRange,
+            [=](sycl::nd_item<2> item, sycl::kernel_handler kernel_handler) {
+          auto group = item.get_group();
+          const long kGroupRow = item.get_group(0) * kGroupSize;
+          const long kGroupColumn = item.get_group(1) * kGroupSize;
+          const long kLocalRow = item.get_local_id(0);
+          const long kLocalColumn = item.get_local_id(1);
+          const bool kInside = kGroupRow + kLocalRow < kRows &&
+                               kGroupColumn + kLocalColumn < kColumns;
+          const long kRow = kGroupRow + kLocalRow + kPadding;
+          const long kColumn = kGroupColumn + kLocalColumn + kPadding;
+
+          // Load tile, the last groups may go past the padded image
+          for (long row = kLocalRow; row < kTileRange[0]; row += kGroupSize) {
+            for (long column = kLocalColumn;
+                column < kTileRange[1];
+                column += kGroupSize) {
+              const long kTileRow = kGroupRow + row;
+              const long kTileColumn = kGroupColumn + column;
+              tile[row][column] = kTileRow < kPaddedRange[0] &&
+                                  kTileColumn < kPaddedRange[1] ?
+                                  marker[kTileRow][kTileColumn] : kLowest;
+            }
+          }
+          const T kMask = kInside ? mask[kRow][kColumn] : kLowest;
+          sycl::group_barrier(group);
+
+          // Propagate inside the tile until it is stable
+          const long kTileRow = kLocalRow + kPadding;
+          const long kTileColumn = kLocalColumn + kPadding;
+          bool group_changed{false};
+          bool tile_changed{true};
+          while (tile_changed) {
+            const T kCurrent = tile[kTileRow][kTileColumn];
+            T value = kCurrent;
+            if (kInside) {
+              T maximum = DilatePixel<T>(kernel_handler, [&](int row, int column) {
+                return tile[kTileRow + row][kTileColumn + column];
+              });
+              value = std::max(kCurrent, std::min(maximum, kMask));
+            }
+            sycl::group_barrier(group);
+            tile[kTileRow][kTileColumn] = value;
+            sycl::group_barrier(group);
+            tile_changed = sycl::any_of_group(group, value != kCurrent);
+            group_changed = group_changed || tile_changed;
+          }
+
+          // Write output
+          if (kInside) {
+            next_marker[kRow][kColumn] = tile[kTileRow][kTileColumn];
+          }
+          if (group_changed && group.leader()) {
+            sycl::atomic_ref<int, sycl::memory_order::relaxed,
+                             sycl::memory_scope::device,
+                             sycl::access::address_space::global_space>
+              flag{changed_flag[0]};
+            flag.store(1);
+          }
+        });
+      });
+      {
+        sycl::host_accessor changed_flag{changed_buffer, sycl::read_only};
+        changed = changed_flag[0] != 0;
+      }
+      std::swap(marker_buffer, next_marker_buffer);
+    }
+
+    // Copy the interior of the marker back into the image
+    queue_.submit([&](sycl::handler& handler) {
+      sycl::accessor marker{marker_buffer, handler, sycl::read_only};
+      sycl::accessor output_accessor{output_buffer, handler, sycl::write_only};
+      handler.parallel_for<ReconstructCopyKernel<T>>(kImageRange,
+          [=](sycl::item<2> item) {
+        output_accessor[item[0]][item[1] + kPadding] =
+          marker[item[0] + kPadding][item[1] + kPadding];
+      });
+    });
+    queue_.wait_and_throw();
+    }
+  }
+ private:
+  // Rows and columns of the work-groups of the propagation rounds.
+  static constexpr std::size_t kGroupSize = 16;
+
+  sycl::queue queue_;
+  SelKernelCache<T> kernel_cache_;
+};
+
+/**
+ * @brief Creates a Reconstruct instance using dynamic memory. Is the user's
+ *  responsibility to free the memory.
+ * @param data_type The type of data it operates with.
+ *  Uses CFITSIO data type enum.
+ * @returns A Reconstruct object as its base class poiner.
+ */
+Morphology* NewReconstruct(int data_type);
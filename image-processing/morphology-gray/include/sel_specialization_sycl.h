@@ -0,0 +1,199 @@
+/**
+ * @brief Specialization constants that describe a structuring element and the
+ *  cache of the kernels specialized with them.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+#include <sycl/sycl.hpp>
+
+#include "templated_structuring_element.h"
+
+// Maximum amount of SE cells that fit in the mask specialization constant.
+constexpr long kMaxSelCells = 64 * 64;
+
+/**
+ * @brief Bit-packed SE mask, bit `i` of word `w` is the cell `64 * w + i`.
+ */
+struct PackedSelMask {
+  std::uint64_t words[kMaxSelCells / 64] = {};
+};
+
+// SE geometry and mask. Known when the kernel is JIT-compiled, so the SE loops
+// get unrolled and the zero taps disappear. Ahead-of-time builds read them at
+// run time instead.
+inline constexpr sycl::specialization_id<int> kSelRows{1};
+inline constexpr sycl::specialization_id<int> kSelColumns{1};
+inline constexpr sycl::specialization_id<int> kSelCenterRow{0};
+inline constexpr sycl::specialization_id<int> kSelCenterColumn{0};
+inline constexpr sycl::specialization_id<PackedSelMask> kSelMask{};
+
+/**
+ * @brief Erodes a pixel with the structuring element of the specialization
+ *  constants. Must be called from a kernel built by a SelKernelCache.
+ * @param kernel_handler Kernel handler of the calling kernel.
+ * @param neighbour Callable that gives the pixel at a (row, column) offset
+ *  from the eroded pixel.
+ * @returns The eroded pixel.
+ */
+template<typename T, typename Neighbour>
+inline T ErodePixel(sycl::kernel_handler& kernel_handler, Neighbour neighbour) {
+  const int kRows = kernel_handler.get_specialization_constant<kSelRows>();
+  const int kColumns = kernel_handler.get_specialization_constant<kSelColumns>();
+  const int kCenterRow =
+    kernel_handler.get_specialization_constant<kSelCenterRow>();
+  const int kCenterColumn =
+    kernel_handler.get_specialization_constant<kSelCenterColumn>();
+  const PackedSelMask kMask =
+    kernel_handler.get_specialization_constant<kSelMask>();
+  T minimum = std::numeric_limits<T>::max();
+  for (int row = 0; row < kRows; ++row) {
+    for (int column = 0; column < kColumns; ++column) {
+      const int kCell = row * kColumns + column;
+      if (((kMask.words[kCell / 64] >> (kCell % 64)) & 1) == 0) {
+        continue;
+      }
+      T value = neighbour(row - kCenterRow, column - kCenterColumn);
+      if (value < minimum) {
+        minimum = value;
+      }
+    }
+  }
+  return minimum;
+}
+
+/**
+ * @brief Dilates a pixel with the structuring element of the specialization
+ *  constants, reflected around its origin. Must be called from a kernel
+ *  built by a SelKernelCache.
+ * @param kernel_handler Kernel handler of the calling kernel.
+ * @param neighbour Callable that gives the pixel at a (row, column) offset
+ *  from the dilated pixel.
+ * @returns The dilated pixel.
+ */
+template<typename T, typename Neighbour>
+inline T DilatePixel(sycl::kernel_handler& kernel_handler, Neighbour neighbour) {
+  const int kRows = kernel_handler.get_specialization_constant<kSelRows>();
+  const int kColumns = kernel_handler.get_specialization_constant<kSelColumns>();
+  const int kCenterRow =
+    kernel_handler.get_specialization_constant<kSelCenterRow>();
+  const int kCenterColumn =
+    kernel_handler.get_specialization_constant<kSelCenterColumn>();
+  const PackedSelMask kMask =
+    kernel_handler.get_specialization_constant<kSelMask>();
+  T maximum = std::numeric_limits<T>::lowest();
+  for (int row = 0; row < kRows; ++row) {
+    for (int column = 0; column < kColumns; ++column) {
+      const int kCell = row * kColumns + column;
+      if (((kMask.words[kCell / 64] >> (kCell % 64)) & 1) == 0) {
+        continue;
+      }
+      T value = neighbour(kCenterRow - row, kCenterColumn - column);
+      if (value > maximum) {
+        maximum = value;
+      }
+    }
+  }
+  return maximum;
+}
+
+/**
+ * @brief Builds kernels specialized for structuring elements. A kernel is
+ *  built the first time an SE is used, usually when its operation is
+ *  prepared, and reused for every following SE with the same geometry and
+ *  mask. The SEs are looked up by hash and compared, so two SEs whose hashes
+ *  collide get their own kernels. Can be used from several threads.
+ */
+template<typename T>
+class SelKernelCache {
+ public:
+  using ExecutableBundle = sycl::kernel_bundle<sycl::bundle_state::executable>;
+  /**
+   * @param queue Queue whose device the kernels are built for.
+   * @param kernel_ids Kernels to specialize, all of them are built together.
+   */
+  SelKernelCache(const sycl::queue& queue,
+                 std::vector<sycl::kernel_id> kernel_ids):
+      context_{queue.get_context()}, device_{queue.get_device()},
+      kernel_ids_{std::move(kernel_ids)} {}
+  /**
+   * @brief Gives the kernels specialized for the structuring element.
+   * @param sel Structuring element the kernels are specialized for.
+   * @returns The executable kernel bundle.
+   */
+  ExecutableBundle& Get(TemplatedStructuringElement<T>& sel) {
+    if (sel.Rows() * sel.Columns() > kMaxSelCells) {
+      throw std::invalid_argument("Structuring element too large for SYCL.");
+    }
+    Specialization specialization{sel.Rows(), sel.Columns(), sel.CenterRow(),
+                                  sel.CenterColumn(), {}};
+    std::vector<std::uint64_t> packed_mask{sel.PackedMask()};
+    std::copy(packed_mask.begin(), packed_mask.end(),
+              specialization.mask.words);
+    const std::size_t kHash{sel.Hash()};
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto [first_bundle, last_bundle] = bundles_.equal_range(kHash);
+    for (auto cached_bundle = first_bundle;
+        cached_bundle != last_bundle;
+        ++cached_bundle) {
+      if (cached_bundle->second.specialization == specialization) {
+        return cached_bundle->second.bundle;
+      }
+    }
+    sycl::kernel_bundle<sycl::bundle_state::input> input_bundle =
+      sycl::get_kernel_bundle<sycl::bundle_state::input>(
+        context_, {device_}, kernel_ids_);
+    input_bundle.set_specialization_constant<kSelRows>(
+      static_cast<int>(sel.Rows()));
+    input_bundle.set_specialization_constant<kSelColumns>(
+      static_cast<int>(sel.Columns()));
+    input_bundle.set_specialization_constant<kSelCenterRow>(
+      static_cast<int>(sel.CenterRow()));
+    input_bundle.set_specialization_constant<kSelCenterColumn>(
+      static_cast<int>(sel.CenterColumn()));
+    input_bundle.set_specialization_constant<kSelMask>(specialization.mask);
+    return bundles_.emplace(kHash, CachedBundle{specialization,
+                                                sycl::build(input_bundle)})
+      ->second.bundle;
+  }
+ private:
+  /**
+   * @brief What the kernels are specialized with, compared when the hashes
+   *  of two SEs match.
+   */
+  struct Specialization {
+    long rows;
+    long columns;
+    long center_row;
+    long center_column;
+    PackedSelMask mask;
+    bool operator==(const Specialization& other) const {
+      return rows == other.rows && columns == other.columns &&
+             center_row == other.center_row &&
+             center_column == other.center_column &&
+             std::equal(std::begin(mask.words), std::end(mask.words),
+                        std::begin(other.mask.words));
+    }
+  };
+  struct CachedBundle {
+    Specialization specialization;
+    ExecutableBundle bundle;
+  };
+
+  sycl::context context_;
+  sycl::device device_;
+  std::vector<sycl::kernel_id> kernel_ids_;
+  // Specialized kernels by SE hash, several if the hashes collide
+  std::unordered_multimap<std::size_t, CachedBundle> bundles_;
+  std::mutex mutex_;
+};
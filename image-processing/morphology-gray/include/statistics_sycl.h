@@ -0,0 +1,232 @@
+/**
+ * @brief Statistics of an image already on a SYCL device, used to calculate
+ *  the binarization thresholds without copying the image back.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+#include <sycl/sycl.hpp>
+
+template<typename T, typename Sum> class MeanKernel;
+template<typename T> class HistogramKernel;
+template<typename T> class SelectDigitKernel;
+
+namespace DeviceStatistics {
+  // Bits of each radix select digit, its histogram fits any local memory.
+  constexpr int kDigitBits = 8;
+  constexpr int kBins = 1 << kDigitBits;
+  // Work-items of the histogram work-groups.
+  constexpr std::size_t kGroupSize = kBins;
+  // Upper bound of the histogram work-groups, each one covers several pixels.
+  constexpr std::size_t kMaxGroups = 1024;
+
+  /**
+   * @brief Maps a pixel into an unsigned key with the same order.
+   * @param value Pixel to map.
+   * @returns The key.
+   */
+  template<typename T>
+  inline std::uint64_t OrderedKey(T value) {
+    if constexpr (std::is_floating_point_v<T>) {
+      using Bits = std::conditional_t<sizeof(T) == 4, std::uint32_t, std::uint64_t>;
+      const Bits kSign = Bits{1} << (sizeof(T) * 8 - 1);
+      Bits bits = sycl::bit_cast<Bits>(value);
+      return (bits & kSign) ? static_cast<Bits>(~bits) : (bits | kSign);
+    } else if constexpr (std::is_signed_v<T>) {
+      using Bits = std::make_unsigned_t<T>;
+      const Bits kSign = static_cast<Bits>(Bits{1} << (sizeof(T) * 8 - 1));
+      return static_cast<Bits>(static_cast<Bits>(value) ^ kSign);
+    } else {
+      return value;
+    }
+  }
+
+  /**
+   * @brief Maps a key back into the pixel it was calculated from.
+   * @param key Key obtained with OrderedKey().
+   * @returns The pixel.
+   */
+  template<typename T>
+  inline T FromOrderedKey(std::uint64_t key) {
+    if constexpr (std::is_floating_point_v<T>) {
+      using Bits = std::conditional_t<sizeof(T) == 4, std::uint32_t, std::uint64_t>;
+      const Bits kSign = Bits{1} << (sizeof(T) * 8 - 1);
+      Bits bits = static_cast<Bits>(key);
+      return sycl::bit_cast<T>((bits & kSign) ? (bits ^ kSign) :
+                                                static_cast<Bits>(~bits));
+    } else if constexpr (std::is_signed_v<T>) {
+      using Bits = std::make_unsigned_t<T>;
+      const Bits kSign = static_cast<Bits>(Bits{1} << (sizeof(T) * 8 - 1));
+      return static_cast<T>(static_cast<Bits>(static_cast<Bits>(key) ^ kSign));
+    } else {
+      return static_cast<T>(key);
+    }
+  }
+
+  /**
+   * @brief Adds up the pixels of the image with a SYCL reduction.
+   * @param queue Queue of the device holding the image.
+   * @param image_buffer Padded image.
+   * @param padding Padding amount around the image.
+   * @param rows Amount of rows of the image, without padding.
+   * @param columns Amount of columns of the image, without padding.
+   * @returns The sum of the pixels.
+   */
+  template<typename T, typename Sum>
+  Sum SumPixels(sycl::queue& queue, sycl::buffer<T, 2>& image_buffer,
+                long padding, long rows, long columns) {
+    sycl::buffer<Sum, 1> sum_buffer{sycl::range(1)};
+    queue.submit([&](sycl::handler& handler) {
+      sycl::accessor image_accessor{image_buffer, handler, sycl::read_only};
+      auto sum_reduction = sycl::reduction(sum_buffer, handler, sycl::plus<Sum>(),
+        {sycl::property::reduction::initialize_to_identity{}});
+      handler.parallel_for<MeanKernel<T, Sum>>(sycl::range(rows, columns),
+          sum_reduction, [=](sycl::item<2> item, auto& sum) {
+        sum += static_cast<Sum>(
+          image_accessor[item[0] + padding][item[1] + padding]);
+      });
+    });
+    sycl::host_accessor sum{sum_buffer, sycl::read_only};
+    return sum[0];
+  }
+
+  /**
+   * @brief Calculates the mean of the pixels of an image on the device.
+   *  Accumulates in double precision if the device supports it.
+   * @param queue Queue of the device holding the image.
+   * @param image_buffer Padded image.
+   * @param padding Padding amount around the image.
+   * @param rows Amount of rows of the image, without padding.
+   * @param columns Amount of columns of the image, without padding.
+   * @returns The mean value.
+   */
+  template<typename T>
+  double Mean(sycl::queue& queue, sycl::buffer<T, 2>& image_buffer,
+              long padding, long rows, long columns) {
+    double sum;
+    if (queue.get_device().has(sycl::aspect::fp64)) {
+      sum = SumPixels<T, double>(queue, image_buffer, padding, rows, columns);
+    } else {
+      sum = SumPixels<T, float>(queue, image_buffer, padding, rows, columns);
+    }
+    return sum / static_cast<double>(rows * columns);
+  }
+
+  /**
+   * @brief Finds the k-th smallest pixel of an image on the device using a
+   *  radix select. Each pass builds a work-group privatized histogram of the
+   *  next digit among the pixels that match the digits selected so far, then
+   *  a single task picks the digit that holds the k-th pixel. The state stays
+   *  on the device, only the final key is copied back.
+   * @param queue Queue of the device holding the image.
+   * @param image_buffer Padded image.
+   * @param padding Padding amount around the image.
+   * @param rows Amount of rows of the image, without padding.
+   * @param columns Amount of columns of the image, without padding.
+   * @param k Position of the pixel in the sorted image, starting at 0.
+   * @returns The k-th smallest pixel.
+   */
+  template<typename T>
+  T Select(sycl::queue& queue, sycl::buffer<T, 2>& image_buffer,
+           long padding, long rows, long columns, long k) {
+    // Prefix of the selected digits, its mask and the position left
+    std::uint64_t initial_state[3] = {0, 0, static_cast<std::uint64_t>(k)};
+    sycl::buffer<std::uint64_t, 1> state_buffer{initial_state, sycl::range(3)};
+    state_buffer.set_final_data(nullptr);
+    std::uint32_t initial_histogram[kBins] = {};
+    sycl::buffer<std::uint32_t, 1> histogram_buffer{initial_histogram,
+                                                    sycl::range(kBins)};
+    histogram_buffer.set_final_data(nullptr);
+    const std::size_t kPixels = rows * columns;
+    const std::size_t kGroups = std::min(kMaxGroups,
+                                         (kPixels + kGroupSize - 1) / kGroupSize);
+    const auto kNdRange = sycl::nd_range(sycl::range(kGroups * kGroupSize),
+                                         sycl::range(kGroupSize));
+    for (int shift = sizeof(T) * 8 - kDigitBits; shift >= 0; shift -= kDigitBits) {
+      queue.submit([&](sycl::handler& handler) {
+        sycl::accessor image_accessor{image_buffer, handler, sycl::read_only};
+        sycl::accessor state{state_buffer, handler, sycl::read_only};
+        sycl::accessor histogram{histogram_buffer, handler, sycl::read_write};
+        auto local_histogram =
+          sycl::local_accessor<std::uint32_t, 1>(sycl::range(kBins), handler);
+        handler.parallel_for<HistogramKernel<T>>(kNdRange,
+            [=](sycl::nd_item<1> item) {
+          const std::size_t kLocalId = item.get_local_id(0);
+          local_histogram[kLocalId] = 0;
+          sycl::group_barrier(item.get_group());
+          const std::uint64_t kPrefix = state[0];
+          const std::uint64_t kMask = state[1];
+          for (std::size_t pixel = item.get_global_id(0);
+              pixel < kPixels;
+              pixel += item.get_global_range(0)) {
+            const std::uint64_t kKey = OrderedKey(
+              image_accessor[pixel / columns + padding][pixel % columns + padding]);
+            if ((kKey & kMask) == kPrefix) {
+              sycl::atomic_ref<std::uint32_t, sycl::memory_order::relaxed,
+                               sycl::memory_scope::work_group,
+                               sycl::access::address_space::local_space>
+                bin{local_histogram[(kKey >> shift) & (kBins - 1)]};
+              bin.fetch_add(1);
+            }
+          }
+          sycl::group_barrier(item.get_group());
+          if (local_histogram[kLocalId] != 0) {
+            sycl::atomic_ref<std::uint32_t, sycl::memory_order::relaxed,
+                             sycl::memory_scope::device,
+                             sycl::access::address_space::global_space>
+              bin{histogram[kLocalId]};
+            bin.fetch_add(local_histogram[kLocalId]);
+          }
+        });
+      });
+      queue.submit([&](sycl::handler& handler) {
+        sycl::accessor state{state_buffer, handler, sycl::read_write};
+        sycl::accessor histogram{histogram_buffer, handler, sycl::read_write};
+        handler.single_task<SelectDigitKernel<T>>([=]() {
+          std::uint64_t position = state[2];
+          int digit = 0;
+          for (; digit < kBins - 1 && histogram[digit] <= position; ++digit) {
+            position -= histogram[digit];
+          }
+          state[0] |= static_cast<std::uint64_t>(digit) << shift;
+          state[1] |= static_cast<std::uint64_t>(kBins - 1) << shift;
+          state[2] = position;
+          // Ready for the next pass
+          for (int bin = 0; bin < kBins; ++bin) {
+            histogram[bin] = 0;
+          }
+        });
+      });
+    }
+    sycl::host_accessor state{state_buffer, sycl::read_only};
+    return FromOrderedKey<T>(state[0]);
+  }
+
+  /**
+   * @brief Calculates the median of the pixels of an image on the device.
+   *  Integer images of 8 bits need a single histogram, the rest of the types
+   *  a radix select of one pass per byte.
+   * @param queue Queue of the device holding the image.
+   * @param image_buffer Padded image.
+   * @param padding Padding amount around the image.
+   * @param rows Amount of rows of the image, without padding.
+   * @param columns Amount of columns of the image, without padding.
+   * @returns The median value.
+   */
+  template<typename T>
+  double Median(sycl::queue& queue, sycl::buffer<T, 2>& image_buffer,
+                long padding, long rows, long columns) {
+    const long kPixels{rows * columns};
+    double median{static_cast<double>(
+      Select<T>(queue, image_buffer, padding, rows, columns, kPixels / 2))};
+    if (kPixels % 2 == 0) {
+      median = (median + static_cast<double>(Select<T>(
+        queue, image_buffer, padding, rows, columns, kPixels / 2 - 1))) / 2.0;
+    }
+    return median;
+  }
+}
@@ -0,0 +1,166 @@
+/**
+ * @brief StreamingErode class which implements the morphological erosion
+ *  operation as a pipeline of strips of rows.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#pragma once
+
+#include "streaming_morphology.h"
+
+#include <algorithm>
+#include <array>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "templated_fits_image.h"
+#include "templated_structuring_element.h"
+#include "fits_utils.h"
+#include "erode_region.h"
+
+/**
+ * @brief Performs a morphological erosion streaming the image through memory
+ *  in strips of rows with a halo around them, so the memory used depends on
+ *  the strip instead of the image. While strip `i` is eroded, strip `i + 1`
+ *  is read from the FITS file and strip `i - 1` is written to the output file.
+ * @note The reads and writes run on different threads. Without a reentrant
+ *  build of CFITSIO they take turns, still overlapping the erosion.
+ */
+template<typename T>
+class StreamingErode: public StreamingMorphology {
+ public:
+  StreamingErode() {}
+  ~StreamingErode() override {}
+  /**
+   * @brief Performs a morphological erosion reading the image in strips of
+   *  rows and writing each eroded strip to the output file.
+   * @param fits_image FITS image to transform, does not need to be loaded.
+   * @param operation_sel Structuring element for the operation.
+   * @param output_file_name Output FITS file, overwritten if it exists.
+   * @param strip_rows Amount of rows of each strip.
+   */
+  void Stream(FitsImage* fits_image, StructuringElement* operation_sel,
+              const std::string& output_file_name, long strip_rows) override {
+    TemplatedFitsImage<T>& image =
+      *dynamic_cast<TemplatedFitsImage<T>*>(fits_image);
+    TemplatedStructuringElement<T>& sel =
+      *dynamic_cast<TemplatedStructuringElement<T>*>(operation_sel);
+    const long kPadding{std::max(sel.Rows(), sel.Columns())};
+    const long kColumns{image.Columns()};
+    const long kPaddedColumns{kColumns + 2 * kPadding};
+    const long kStrips{(image.Rows() + strip_rows - 1) / strip_rows};
+    const T kFilling{image.GetFilling(PaddingType::MAX, 0)};
+
+    // One strip being eroded and another one being read or written.
+    // The output strips keep the padded pitch of the input ones.
+    std::array<std::vector<T>, kBuffers> inputs, outputs;
+    for (long buffer{0}; buffer < kBuffers; ++buffer) {
+      inputs[buffer].resize((strip_rows + 2 * kPadding) * kPaddedColumns);
+      outputs[buffer].resize(strip_rows * kPaddedColumns);
+    }
+    std::future<void> read, write;
+    fitsfile* output_file{image.CreateCopy(output_file_name)};
+
+    auto launch_read = [&](long strip) {
+      const long kFirstRow{strip * strip_rows - kPadding};
+      const long kRows{std::min(strip_rows, image.Rows() - strip * strip_rows) +
+                       2 * kPadding};
+      T* destination{inputs[strip % kBuffers].data()};
+      read = std::async(std::launch::async,
+          [this, &image, destination, kFirstRow, kRows, kPadding, kFilling]() {
+        std::unique_lock<std::mutex> lock{
+          FitsUtils::LockUnlessReentrant(fits_mutex_)};
+        image.ReadRows(kFirstRow, kRows, kPadding, kFilling, destination);
+      });
+    };
+
+    try {
+      if (kStrips > 0) {
+        launch_read(0);
+      }
+      for (long strip{0}; strip < kStrips; ++strip) {
+        const std::size_t kBuffer = strip % kBuffers;
+        const long kFirstRow{strip * strip_rows};
+        const long kRows{std::min(strip_rows, image.Rows() - kFirstRow)};
+        read.get();
+        // The other input buffer was eroded on the previous iteration
+        if (strip + 1 < kStrips) {
+          launch_read(strip + 1);
+        }
+        ErodeRegion(inputs[kBuffer].data() + kPadding * kPaddedColumns + kPadding,
+                    outputs[kBuffer].data() + kPadding, kRows, kColumns,
+                    kPaddedColumns, sel);
+        // The previous write used the other output buffer
+        if (write.valid()) {
+          write.get();
+        }
+        T* source{outputs[kBuffer].data() + kPadding};
+        write = std::async(std::launch::async,
+            [this, &image, output_file, source, kFirstRow, kRows,
+             kPaddedColumns]() {
+          std::unique_lock<std::mutex> lock{
+            FitsUtils::LockUnlessReentrant(fits_mutex_)};
+          image.WriteRows(output_file, kFirstRow, kRows, source, kPaddedColumns);
+        });
+      }
+      if (write.valid()) {
+        write.get();
+      }
+    } catch (...) {
+      // Nothing may use the buffers once they are freed
+      if (read.valid()) {
+        read.wait();
+      }
+      if (write.valid()) {
+        write.wait();
+      }
+      int status{0};
+      fits_close_file(output_file, &status);
+      throw;
+    }
+    int status{0};
+    fits_close_file(output_file, &status);
+    if (status != 0) {
+      throw std::runtime_error("The output FITS file could not be closed.");
+    }
+  }
+  /**
+   * @brief Calculates the tallest strip whose buffers fit in a memory budget:
+   *  two padded input strips, two output strips and the rows being read.
+   * @param fits_image FITS image to transform, does not need to be loaded.
+   * @param operation_sel Structuring element for the operation.
+   * @param max_memory Memory budget in bytes.
+   * @returns The amount of rows of each strip.
+   */
+  long StripRows(FitsImage* fits_image, StructuringElement* operation_sel,
+                 std::size_t max_memory) override {
+    const long kPadding{std::max(operation_sel->Rows(), operation_sel->Columns())};
+    const long kColumns{fits_image->Columns()};
+    const long kPaddedColumns{kColumns + 2 * kPadding};
+    const long kRowElements{2 * kBuffers * kPaddedColumns + kColumns};
+    const long kHaloElements{2 * kPadding * (kBuffers * kPaddedColumns + kColumns)};
+    const long kBudgetElements = max_memory / sizeof(T);
+    if (kBudgetElements < kHaloElements + kRowElements) {
+      throw std::invalid_argument("The memory budget does not fit a strip.");
+    }
+    return (kBudgetElements - kHaloElements) / kRowElements;
+  }
+ private:
+  // Strips in flight: one eroded while the other is read or written.
+  static constexpr long kBuffers = 2;
+
+  // Makes the reads and writes take turns without a reentrant CFITSIO
+  std::mutex fits_mutex_;
+};
+
+/**
+ * @brief Creates a StreamingErode instance using dynamic memory. Is the
+ *  user's responsibility to free the memory.
+ * @param data_type The type of data it operates with.
+ *  Uses CFITSIO data type enum.
+ * @returns A StreamingErode object as its base class poiner.
+ */
+StreamingMorphology* NewStreamingErode(int data_type);
@@ -0,0 +1,262 @@
+/**
+ * @brief StreamingErode class which implements the morphological erosion
+ *  operation as a pipeline of strips of rows.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#pragma once
+
+#include "streaming_morphology.h"
+
+#include <algorithm>
+#include <array>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+#include <sycl/sycl.hpp>
+
+#include "templated_fits_image.h"
+#include "templated_structuring_element.h"
+#include "fits_utils.h"
+#include "sel_specialization_sycl.h"
+#include "device_pool_sycl.h"
+#include "trace_sycl.h"
+
+template<typename T> class StreamingErodeKernel;
+
+/**
+ * @brief Performs a morphological erosion streaming the image through the
+ *  device in strips of rows with a halo around them. While strip `i` is
+ *  eroded, strip `i + 1` is transferred to the device, strip `i + 2` is read
+ *  from the FITS file and strip `i - 1` is written to the output file.
+ * @note The reads and writes run on different threads. Without a reentrant
+ *  build of CFITSIO they take turns, still overlapping the erosion.
+ */
+template<typename T>
+class StreamingErode: public StreamingMorphology {
+ public:
+  StreamingErode():
+      queue_{sycl::gpu_selector_v, Trace::QueueProperties()},
+      kernel_cache_{queue_, {sycl::get_kernel_id<StreamingErodeKernel<T>>()}} {}
+  ~StreamingErode() override {}
+  /**
+   * @brief Builds the kernels specialized for the structuring element.
+   * @param operation_sel Structuring element the operation will use.
+   */
+  void Prepare(StructuringElement* operation_sel) override {
+    Trace::Scope trace_scope{"build kernels"};
+    kernel_cache_.Get(
+      *dynamic_cast<TemplatedStructuringElement<T>*>(operation_sel));
+  }
+  /**
+   * @brief Performs a morphological erosion reading the image in strips of
+   *  rows and writing each eroded strip to the output file.
+   * @param fits_image FITS image to transform, does not need to be loaded.
+   * @param operation_sel Structuring element for the operation.
+   * @param output_file_name Output FITS file, overwritten if it exists.
+   * @param strip_rows Amount of rows of each strip.
+   */
+  void Stream(FitsImage* fits_image, StructuringElement* operation_sel,
+              const std::string& output_file_name, long strip_rows) override {
+    TemplatedFitsImage<T>& image =
+      *dynamic_cast<TemplatedFitsImage<T>*>(fits_image);
+    TemplatedStructuringElement<T>& sel =
+      *dynamic_cast<TemplatedStructuringElement<T>*>(operation_sel);
+    auto& kernel_bundle = kernel_cache_.Get(sel);
+    const long kPadding{std::max(sel.Rows(), sel.Columns())};
+    const long kColumns{image.Columns()};
+    const long kPaddedColumns{kColumns + 2 * kPadding};
+    const long kStrips{(image.Rows() + strip_rows - 1) / strip_rows};
+    const T kFilling{image.GetFilling(PaddingType::MAX, 0)};
+
+    // Staging memory, one slot per strip in flight, kept in the pool for the
+    // next image
+    const std::size_t kInputBytes =
+      (strip_rows + 2 * kPadding) * kPaddedColumns * sizeof(T);
+    const std::size_t kOutputBytes = strip_rows * kColumns * sizeof(T);
+    DevicePool& pool = DevicePool::Instance();
+    std::vector<DevicePool::Block> host_inputs, host_outputs, device_inputs,
+                                   device_outputs;
+    for (std::size_t slot{0}; slot < kSlots; ++slot) {
+      host_inputs.push_back(
+        pool.Acquire(queue_, kInputBytes, sycl::usm::alloc::host));
+      host_outputs.push_back(
+        pool.Acquire(queue_, kOutputBytes, sycl::usm::alloc::host));
+      device_inputs.push_back(pool.Acquire(queue_, kInputBytes));
+      device_outputs.push_back(pool.Acquire(queue_, kOutputBytes));
+    }
+    // Last command of each stage on each slot
+    std::array<sycl::event, kSlots> uploads, kernels, downloads;
+    // Reads and writes are chained, each waits for the previous one
+    std::vector<std::shared_future<void>> reads(kStrips), writes(kStrips);
+    // Device commands of every strip, only kept while tracing
+    std::vector<Trace::DeviceCommand> commands;
+    fitsfile* output_file{image.CreateCopy(output_file_name)};
+
+    auto launch_read = [&](long strip) {
+      const std::size_t kSlot = strip % kSlots;
+      const long kFirstRow{strip * strip_rows - kPadding};
+      const long kRows{std::min(strip_rows, image.Rows() - strip * strip_rows) +
+                       2 * kPadding};
+      std::shared_future<void> previous_read;
+      if (strip > 0) {
+        previous_read = reads[strip - 1];
+      }
+      // The slot is free once the strip that used it is on the device
+      sycl::event slot_upload{uploads[kSlot]};
+      T* destination{host_inputs[kSlot].Get<T>()};
+      reads[strip] = std::async(std::launch::async,
+          [this, &image, previous_read, slot_upload, destination, kFirstRow,
+           kRows, kPadding, kFilling]() mutable {
+        if (previous_read.valid()) {
+          previous_read.get();
+        }
+        slot_upload.wait();
+        std::unique_lock<std::mutex> lock{
+          FitsUtils::LockUnlessReentrant(fits_mutex_)};
+        image.ReadRows(kFirstRow, kRows, kPadding, kFilling, destination);
+      }).share();
+    };
+
+    try {
+      long launched_reads{0};
+      for (long strip{0}; strip < kStrips; ++strip) {
+        for (;
+            launched_reads < std::min(strip + kReadAhead + 1, kStrips);
+            ++launched_reads) {
+          launch_read(launched_reads);
+        }
+        const std::size_t kSlot = strip % kSlots;
+        const long kFirstRow{strip * strip_rows};
+        const long kRows{std::min(strip_rows, image.Rows() - kFirstRow)};
+        T* device_input{device_inputs[kSlot].Get<T>()};
+        T* device_output{device_outputs[kSlot].Get<T>()};
+        T* host_output{host_outputs[kSlot].Get<T>()};
+
+        // Transfer, waiting for the kernel that read the slot before
+        reads[strip].get();
+        uploads[kSlot] = queue_.memcpy(
+          device_input, host_inputs[kSlot].Get<T>(),
+          (kRows + 2 * kPadding) * kPaddedColumns * sizeof(T), kernels[kSlot]);
+        // Erode, waiting for the transfer back of the slot before
+        kernels[kSlot] = queue_.submit([&](sycl::handler& handler) {
+          handler.depends_on({uploads[kSlot], downloads[kSlot]});
+          handler.use_kernel_bundle(kernel_bundle);
+          handler.parallel_for<StreamingErodeKernel<T>>(
+              sycl::range(kRows, kColumns),
+              [=](sycl::item<2> item, sycl::kernel_handler kernel_handler) {
+            const long kRow = item[0] + kPadding;
+            const long kColumn = item[1] + kPadding;
+            device_output[item[0] * kColumns + item[1]] =
+              ErodePixel<T>(kernel_handler, [&](int row, int column) {
+                return device_input[(kRow + row) * kPaddedColumns +
+                                    kColumn + column];
+              });
+          });
+        });
+        // Transfer back, once the previous strip of the slot is written
+        if (strip >= static_cast<long>(kSlots)) {
+          writes[strip - kSlots].get();
+        }
+        downloads[kSlot] = queue_.memcpy(host_output, device_output,
+                                         kRows * kColumns * sizeof(T),
+                                         kernels[kSlot]);
+        if (Trace::Enabled()) {
+          commands.push_back({"upload", uploads[kSlot],
+                              (kRows + 2 * kPadding) * kPaddedColumns * sizeof(T)});
+          commands.push_back({"erode kernel", kernels[kSlot], 0});
+          commands.push_back({"download", downloads[kSlot],
+                              kRows * kColumns * sizeof(T)});
+        }
+        // Write
+        std::shared_future<void> previous_write;
+        if (strip > 0) {
+          previous_write = writes[strip - 1];
+        }
+        sycl::event download{downloads[kSlot]};
+        writes[strip] = std::async(std::launch::async,
+            [this, &image, output_file, previous_write, download, host_output,
+             kFirstRow, kRows, kColumns]() mutable {
+          if (previous_write.valid()) {
+            previous_write.get();
+          }
+          download.wait();
+          std::unique_lock<std::mutex> lock{
+            FitsUtils::LockUnlessReentrant(fits_mutex_)};
+          image.WriteRows(output_file, kFirstRow, kRows, host_output, kColumns);
+        }).share();
+      }
+      if (kStrips > 0) {
+        writes[kStrips - 1].get();
+      }
+      queue_.wait_and_throw();
+      Trace::AddDeviceCommands(queue_.get_device(), commands);
+    } catch (...) {
+      // Nothing may use the staging memory once it is back in the pool
+      for (std::shared_future<void>& read : reads) {
+        if (read.valid()) {
+          read.wait();
+        }
+      }
+      for (std::shared_future<void>& write : writes) {
+        if (write.valid()) {
+          write.wait();
+        }
+      }
+      queue_.wait();
+      int status{0};
+      fits_close_file(output_file, &status);
+      throw;
+    }
+    int status{0};
+    fits_close_file(output_file, &status);
+    if (status != 0) {
+      throw std::runtime_error("The output FITS file could not be closed.");
+    }
+  }
+  /**
+   * @brief Calculates the tallest strip whose host buffers fit in a memory
+   *  budget: the staging slots and the rows being read. The device holds as
+   *  much memory as the staging slots.
+   * @param fits_image FITS image to transform, does not need to be loaded.
+   * @param operation_sel Structuring element for the operation.
+   * @param max_memory Memory budget in bytes.
+   * @returns The amount of rows of each strip.
+   */
+  long StripRows(FitsImage* fits_image, StructuringElement* operation_sel,
+                 std::size_t max_memory) override {
+    const long kPadding{std::max(operation_sel->Rows(), operation_sel->Columns())};
+    const long kColumns{fits_image->Columns()};
+    const long kPaddedColumns{kColumns + 2 * kPadding};
+    const long kSlotCount{static_cast<long>(kSlots)};
+    const long kRowElements{kSlotCount * (kPaddedColumns + kColumns) + kColumns};
+    const long kHaloElements{2 * kPadding * (kSlotCount * kPaddedColumns + kColumns)};
+    const long kBudgetElements = max_memory / sizeof(T);
+    if (kBudgetElements < kHaloElements + kRowElements) {
+      throw std::invalid_argument("The memory budget does not fit a strip.");
+    }
+    return (kBudgetElements - kHaloElements) / kRowElements;
+  }
+ private:
+  // Strips in flight: read, transfer, erosion and write.
+  static constexpr std::size_t kSlots = 4;
+  // Strips read ahead of the one being eroded.
+  static constexpr long kReadAhead = 2;
+
+  sycl::queue queue_;
+  SelKernelCache<T> kernel_cache_;
+  // Makes the reads and writes take turns without a reentrant CFITSIO
+  std::mutex fits_mutex_;
+};
+
+/**
+ * @brief Creates a StreamingErode instance using dynamic memory. Is the
+ *  user's responsibility to free the memory.
+ * @param data_type The type of data it operates with.
+ *  Uses CFITSIO data type enum.
+ * @returns A StreamingErode object as its base class poiner.
+ */
+StreamingMorphology* NewStreamingErode(int data_type);
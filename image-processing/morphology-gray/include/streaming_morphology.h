@@ -0,0 +1,49 @@
+/**
+ * @brief StreamingMorphology abstract class that serves as a base for the
+ *  morphology operations that stream the image in strips of rows.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+class FitsImage;
+class StructuringElement;
+
+/**
+ * @brief Represents a morphology operation that never holds the whole image.
+ */
+class StreamingMorphology {
+ public:
+  StreamingMorphology() {}
+  virtual ~StreamingMorphology() = 0;
+  /**
+   * @brief Performs the morphologic operation reading the image in strips of
+   *  rows and writing each transformed strip to the output file.
+   * @param fits_image FITS image to transform, does not need to be loaded.
+   * @param operation_sel Structuring element for the operation.
+   * @param output_file_name Output FITS file, overwritten if it exists.
+   * @param strip_rows Amount of rows of each strip.
+   */
+  virtual void Stream(FitsImage* fits_image, StructuringElement* operation_sel,
+                      const std::string& output_file_name, long strip_rows) = 0;
+  /**
+   * @brief Readies the operation for a structuring element before streaming,
+   *  such as building the kernels specialized for it. Does nothing by default.
+   * @param operation_sel Structuring element the operation will use.
+   */
+  virtual void Prepare(StructuringElement* operation_sel) {}
+  /**
+   * @brief Calculates the tallest strip whose buffers fit in a memory budget.
+   *  Throws an exception if not even one row fits.
+   * @param fits_image FITS image to transform, does not need to be loaded.
+   * @param operation_sel Structuring element for the operation.
+   * @param max_memory Memory budget in bytes.
+   * @returns The amount of rows of each strip.
+   */
+  virtual long StripRows(FitsImage* fits_image, StructuringElement* operation_sel,
+                         std::size_t max_memory) = 0;
+};
@@ -0,0 +1,69 @@
+/**
+ * @brief Generators of synthetic FITS images and structuring elements for the
+ *  benchmarks.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#pragma once
+
+#include <string>
+
+namespace Synthetic {
+  /**
+   * @brief Contents of a synthetic image.
+   */
+  enum class Pattern {
+    GRADIENT, // Diagonal ramp over the whole range of the pixel type
+    NOISE, // Uniform noise
+    STARS // Noisy background with gaussian stars
+  };
+
+  /**
+   * @brief Shape of a synthetic structuring element.
+   */
+  enum class SelShape {
+    SQUARE,
+    CROSS,
+    DISK,
+    LINE // Horizontal line through the center
+  };
+
+  /**
+   * @brief Returns the pattern from its name: gradient, noise or stars.
+   *  Throws an exception if the pattern does not exist.
+   * @param name Name of the pattern.
+   * @returns The pattern.
+   */
+  Pattern GetPattern(const std::string& name);
+
+  /**
+   * @brief Returns the SE shape from its name: square, cross, disk or line.
+   *  Throws an exception if the shape does not exist.
+   * @param name Name of the shape.
+   * @returns The shape.
+   */
+  SelShape GetSelShape(const std::string& name);
+
+  /**
+   * @brief Writes a square synthetic image, row by row so images larger than
+   *  the memory can be generated. The same arguments always give the same
+   *  pixels. Throws an exception if the file cannot be written.
+   * @param file_name FITS file to create, overwritten if it exists.
+   * @param pattern Contents of the image.
+   * @param size Columns and rows of the image.
+   * @param bitpix CFITSIO image type, such as USHORT_IMG or FLOAT_IMG.
+   * @param seed Seed of the noise.
+   */
+  void WriteImage(const std::string& file_name, Pattern pattern, long size,
+                  int bitpix, unsigned seed = 1);
+
+  /**
+   * @brief Writes a square structuring element file centered on its middle
+   *  cell. Throws an exception if the size is not odd and positive.
+   * @param file_name SE file to create, overwritten if it exists.
+   * @param shape Shape of the SE.
+   * @param size Columns and rows of the SE.
+   */
+  void WriteSel(const std::string& file_name, SelShape shape, long size);
+}
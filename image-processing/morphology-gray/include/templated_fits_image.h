@@ -11,8 +11,19 @@
 #include <fitsio.h>
 #include <algorithm>
 #include <limits>
+#include <vector>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <thread>
+#include <exception>
+#include <new>
+#include <unistd.h>
 
 #include "fits_image.h"
+#include "fits_utils.h"
+#include "mapped_file.h"
+#include "trace.h"
 
 /**
  * @brief Manages FITS images
@@ -25,8 +36,8 @@ template<typename T>
 class TemplatedFitsImage: public FitsImage {
  public:
   TemplatedFitsImage(fitsfile* fits_file, OpeningMode mode):
-      FitsImage{fits_file, mode}, image_data_{nullptr} {}
-  ~TemplatedFitsImage() override { delete[] image_data_; }
+      FitsImage{fits_file, mode}, image_data_{nullptr}, scratch_data_{nullptr} {}
+  ~TemplatedFitsImage() override { FreeData(); }
   /**
    * @brief Copies the header information of another FitsImage into this one.
    * @param other_image The FitsImage to copy the header from.
@@ -36,9 +47,32 @@ class TemplatedFitsImage: public FitsImage {
   }
   // Gives a pointer to the actual data of the image
   inline T* GetData() { return image_data_; }
+  /**
+   * @brief Gives a second buffer with the layout of the loaded image, for the
+   *  operations that cannot work in place. It is kept until the image is
+   *  loaded again, so the steps of a chain reuse it. Its padding is not
+   *  filled.
+   * @returns The buffer, with PaddedTotalElements() elements.
+   */
+  T* GetScratch() {
+    if (scratch_data_ == nullptr) {
+      scratch_data_ = static_cast<T*>(::operator new[](
+        padded_total_elements_ * sizeof(T), std::align_val_t{kRowAlignment}));
+    }
+    return scratch_data_;
+  }
+  /**
+   * @brief Makes the scratch buffer, where an operation wrote its result, the
+   *  image, and the image the scratch buffer. The steps of a chain alternate
+   *  between both buffers without copying the image. The padding of the new
+   *  image is left as it was, Refill() fills it.
+   */
+  inline void SwapScratch() { std::swap(image_data_, scratch_data_); }
   /**
    * @brief Reads the image from the original FITS file to the internal array.
-   *  Overwrites the internal image.
+   *  Overwrites the internal image. Uncompressed images are decoded straight
+   *  from a mapping of the file into the padded array. Bands of rows are
+   *  loaded concurrently by the threads set with SetIoThreads().
    * @param padding Padding amount around the image.
    * @param padding_type Type of the padding value.
    * @param filling Padding value if padding_type is CUSTOM, ignored otherwise.
@@ -46,73 +80,128 @@ class TemplatedFitsImage: public FitsImage {
   void Load(long padding = 0,
             PaddingType padding_type = PaddingType::CUSTOM,
             double filling = 0) override {
-    delete[] image_data_;
+    Trace::Scope scope{"load", total_elements_ * sizeof(T)};
+    FreeData();
     padding_ = padding;
     const long twice_padding{2 * padding};
-    padded_total_elements_ = 1;
     for (unsigned dimension{0}; dimension < kAmountOfAxis; ++dimension) {
       padded_dimensions_[dimension] = twice_padding + dimensions_[dimension];
-      padded_total_elements_ *= padded_dimensions_[dimension];
-    }
-    image_data_ = new T[padded_total_elements_];
-    T data_filling = GetFilling(padding_type, filling);
-    std::fill(image_data_, image_data_ + padded_total_elements_, data_filling);
-    long first_element{1};
-    T* image_data_pointer{image_data_ + padding_ * padded_dimensions_[0] + padding_};
-    T* original_row = new T[dimensions_[0]];
-    for (int row{0};
-        row < dimensions_[1];
-        image_data_pointer += padded_dimensions_[0],
-        first_element += dimensions_[0],
-        ++row) {
-      fits_read_img(fits_file_, data_type_, first_element, dimensions_[0], nullptr,
-                    original_row, nullptr, &status_);
-      for (long index{0}; index < dimensions_[0]; ++index) {
-        image_data_pointer[index] = original_row[index];
+    }
+    // Every row starts at a cache line
+    constexpr long kLineElements{static_cast<long>(kRowAlignment / sizeof(T))};
+    row_pitch_ = (padded_dimensions_[0] + kLineElements - 1) / kLineElements *
+                 kLineElements;
+    padded_total_elements_ = padded_dimensions_[1] * row_pitch_;
+    MappedFile mapping;
+    const unsigned char* mapped_data{MapDataUnit(mapping)};
+    const bool kFlipSign{FlipsSign()};
+    image_data_ = static_cast<T*>(::operator new[](
+      padded_total_elements_ * sizeof(T), std::align_val_t{kRowAlignment}));
+    FillPadding(GetFilling(padding_type, filling));
+    // Bands of rows loaded concurrently, CFITSIO handles are not shared
+    const long kThreads{std::min<long>(
+      fits_is_reentrant() || mapped_data != nullptr ? io_threads_ : 1,
+      std::max(dimensions_[1], 1L))};
+    if (kThreads == 1) {
+      LoadRows(mapped_data, fits_file_, 0, dimensions_[1], kFlipSign);
+      return;
+    }
+    std::vector<std::thread> workers;
+    std::vector<std::exception_ptr> errors(kThreads);
+    for (long thread{0}; thread < kThreads; ++thread) {
+      const long kFirstRow{BandStart(thread, kThreads)};
+      const long kRows{BandStart(thread + 1, kThreads) - kFirstRow};
+      workers.emplace_back([&, thread, kFirstRow, kRows]() {
+        fitsfile* handle{nullptr};
+        try {
+          if (mapped_data == nullptr) {
+            handle = OpenHandle();
+          }
+          LoadRows(mapped_data, handle, kFirstRow, kRows, kFlipSign);
+        } catch (...) {
+          errors[thread] = std::current_exception();
+        }
+        if (handle != nullptr) {
+          int status{0};
+          fits_close_file(handle, &status);
+        }
+      });
+    }
+    for (std::thread& worker : workers) {
+      worker.join();
+    }
+    for (std::exception_ptr& error : errors) {
+      if (error) {
+        std::rethrow_exception(error);
       }
     }
   }
-  // Calculates the median value of the original image.
-  double CalculateMedian() override {
-    T* data = new T[total_elements_];
-    fits_read_img(fits_file_, data_type_, 1, total_elements_, nullptr, data,
-      nullptr, &status_);
-    std::sort(data, data + total_elements_);
-    double median;
-    if (total_elements_ % 2 == 0) {
-      median = (data[total_elements_ / 2 - 1] + data[total_elements_ / 2]) / 2.0;
-    } else {
-      median = data[total_elements_ / 2];
-    }
-    delete[] data;
-    return median;
+  // Fills the padding of the loaded image again.
+  void Refill(PaddingType padding_type, double filling = 0.0) override {
+    FillPadding(GetFilling(padding_type, filling));
   }
-  // Calculates the mean value of the original image.
-  double CalculateMean() override {
-    T* data = new T[total_elements_];
-    fits_read_img(fits_file_, data_type_, 1, total_elements_, nullptr, data,
-      nullptr, &status_);
-    double sum{0};
-    for (long i = 0; i < total_elements_; ++i) {
-      sum += data[i];
+  /**
+   * @brief Reads a strip of rows from the original FITS file, with padding
+   *  around each row. The rows outside of the image are filled.
+   * @param first_row First row to read, may be negative.
+   * @param amount Amount of rows to read.
+   * @param padding Padding amount at both sides of each row.
+   * @param filling Value of the padding and of the rows outside of the image.
+   * @param destination Where the strip is stored, `amount` rows of
+   *  `Columns() + 2 * padding` elements.
+   */
+  void ReadRows(long first_row, long amount, long padding, T filling,
+                T* destination) {
+    Trace::Scope scope{"read strip", amount * dimensions_[0] * sizeof(T)};
+    const long kPaddedColumns{dimensions_[0] + 2 * padding};
+    std::fill(destination, destination + amount * kPaddedColumns, filling);
+    const long kFirstImageRow{std::max(first_row, 0L)};
+    const long kLastImageRow{std::min(first_row + amount, dimensions_[1])};
+    if (kLastImageRow <= kFirstImageRow) {
+      return;
+    }
+    std::vector<T> rows((kLastImageRow - kFirstImageRow) * dimensions_[0]);
+    ReadImageRows(fits_file_, kFirstImageRow, kLastImageRow - kFirstImageRow,
+                  rows.data(), status_);
+    if (status_ != 0) {
+      throw std::runtime_error("Reading rows from the FITS file failed.");
+    }
+    T* destination_row{destination +
+                       (kFirstImageRow - first_row) * kPaddedColumns + padding};
+    for (auto row = rows.begin();
+        row != rows.end();
+        row += dimensions_[0], destination_row += kPaddedColumns) {
+      std::copy(row, row + dimensions_[0], destination_row);
     }
-    delete[] data;
-    return sum / static_cast<double>(total_elements_);
   }
- private:
   /**
-   * @brief Writes only the image data into the given FITS file.
+   * @brief Writes a strip of rows into the image data of a FITS file with the
+   *  same shape as this image. Can be used while reading from this image.
    * @param fits_file FITS file pointer.
+   * @param first_row First row to write.
+   * @param amount Amount of rows to write.
+   * @param source Rows to write.
+   * @param source_pitch Distance, in elements, between two consecutive rows of
+   *  the source.
    */
-  void WriteImageData(fitsfile* fits_file) override {
-    long first_element{1};
-    T* image_data_pointer{image_data_ + padding_ * padded_dimensions_[0] + padding_};
-    for (int row{0};
-        row < dimensions_[1];
-        image_data_pointer += padded_dimensions_[0],
-        first_element += dimensions_[0],
-        ++row) {
-      fits_write_img(fits_file, data_type_, first_element, dimensions_[0], image_data_pointer, &status_);
+  void WriteRows(fitsfile* fits_file, long first_row, long amount, T* source,
+                 long source_pitch) {
+    Trace::Scope scope{"write strip", amount * dimensions_[0] * sizeof(T)};
+    int status{0};
+    long first_element{PlaneOffset() + first_row * dimensions_[0] + 1};
+    if (source_pitch == dimensions_[0]) {
+      fits_write_img(fits_file, data_type_, first_element,
+                     amount * dimensions_[0], source, &status);
+    } else {
+      for (long row{0};
+          row < amount;
+          source += source_pitch, first_element += dimensions_[0], ++row) {
+        fits_write_img(fits_file, data_type_, first_element, dimensions_[0],
+                       source, &status);
+      }
+    }
+    if (status != 0) {
+      throw std::runtime_error("Writing rows to the FITS file failed.");
     }
   }
   /**
@@ -143,8 +232,275 @@ class TemplatedFitsImage: public FitsImage {
     }
     return padding_value;
   }
+  // Calculates the median value of the loaded image, scaled.
+  double CalculateMedian() override {
+    std::vector<T> data;
+    data.reserve(total_elements_);
+    const T* image_data_pointer{image_data_ + padding_ * row_pitch_ + padding_};
+    for (long row{0};
+        row < dimensions_[1];
+        image_data_pointer += row_pitch_, ++row) {
+      data.insert(data.end(), image_data_pointer,
+                  image_data_pointer + dimensions_[0]);
+    }
+    auto middle = data.begin() + total_elements_ / 2;
+    std::nth_element(data.begin(), middle, data.end());
+    double median = *middle;
+    if (total_elements_ % 2 == 0) {
+      median = (*std::max_element(data.begin(), middle) + median) / 2.0;
+    }
+    return zero_ + scale_ * median;
+  }
+  // Calculates the mean value of the loaded image, scaled.
+  double CalculateMean() override {
+    double sum{0};
+    const T* image_data_pointer{image_data_ + padding_ * row_pitch_ + padding_};
+    for (long row{0};
+        row < dimensions_[1];
+        image_data_pointer += row_pitch_, ++row) {
+      for (long column{0}; column < dimensions_[0]; ++column) {
+        sum += image_data_pointer[column];
+      }
+    }
+    return zero_ + scale_ * sum / static_cast<double>(total_elements_);
+  }
+  /**
+   * @brief Transforms the loaded image to binary: the pixels above the
+   *  threshold become 1 and the rest 0. The padding is not modified.
+   * @param threshold Threshold value.
+   */
+  void Binarize(double threshold) override {
+    // Compared with the raw pixels, BSCALE is positive so the order holds
+    const T kThreshold{FitsUtils::ThresholdValue<T>((threshold - zero_) / scale_)};
+    T* image_data_pointer{image_data_ + padding_ * row_pitch_ + padding_};
+    for (long row{0};
+        row < dimensions_[1];
+        image_data_pointer += row_pitch_, ++row) {
+      for (long column{0}; column < dimensions_[0]; ++column) {
+        image_data_pointer[column] = image_data_pointer[column] > kThreshold ?
+                                     static_cast<T>(1) : static_cast<T>(0);
+      }
+    }
+    ClearScaling();
+  }
+ private:
+  /**
+   * @brief Writes only the image data into the given FITS file.
+   * @param fits_file FITS file pointer.
+   */
+  void WriteImageData(fitsfile* fits_file) override {
+    long first_element{PlaneOffset() + 1};
+    T* image_data_pointer{image_data_ +
+                          (padding_ + cutout_start_[1]) * row_pitch_ +
+                          padding_ + cutout_start_[0]};
+    for (int row{0};
+        row < cutout_dimensions_[1];
+        image_data_pointer += row_pitch_,
+        first_element += cutout_dimensions_[0],
+        ++row) {
+      fits_write_img(fits_file, data_type_, first_element, cutout_dimensions_[0], image_data_pointer, &status_);
+    }
+  }
+
+  /**
+   * @brief Writes the image data encoded as in a FITS file, bypassing
+   *  CFITSIO. Each thread encodes a band of rows in chunks and writes every
+   *  chunk at its offset.
+   * @param file_descriptor Output file, open for writing.
+   * @param data_start Offset of the data unit in the file.
+   */
+  void WriteEncodedData(int file_descriptor, long long data_start) override {
+    const bool kFlipSign{FlipsSign()};
+    const std::size_t kRowBytes = dimensions_[0] * sizeof(T);
+    const long kChunkRows{std::max<long>(kWriteChunkBytes / kRowBytes, 1)};
+    const long kThreads{std::min<long>(io_threads_, std::max(dimensions_[1], 1L))};
+    auto write_band = [&](long first_row, long amount) {
+      std::vector<unsigned char> chunk(std::min(kChunkRows, amount) * kRowBytes);
+      for (long chunk_row{first_row};
+          chunk_row < first_row + amount;
+          chunk_row += kChunkRows) {
+        const long kRows{std::min(kChunkRows, first_row + amount - chunk_row)};
+        const T* image_data_pointer{image_data_ +
+                                    (padding_ + chunk_row) * row_pitch_ +
+                                    padding_};
+        for (long row{0}; row < kRows; image_data_pointer += row_pitch_, ++row) {
+          FitsUtils::EncodeBigEndian(image_data_pointer,
+                                     chunk.data() + row * kRowBytes,
+                                     dimensions_[0], kFlipSign);
+        }
+        std::size_t written{0};
+        const std::size_t kBytes = kRows * kRowBytes;
+        const long long kOffset{data_start +
+                                static_cast<long long>(PlaneOffset() * sizeof(T) +
+                                                       chunk_row * kRowBytes)};
+        while (written < kBytes) {
+          ssize_t result{pwrite(file_descriptor, chunk.data() + written,
+                                kBytes - written, kOffset + written)};
+          if (result <= 0) {
+            throw std::runtime_error("Writing the image to the FITS file failed.");
+          }
+          written += result;
+        }
+      }
+    };
+    if (kThreads == 1) {
+      write_band(0, dimensions_[1]);
+      return;
+    }
+    std::vector<std::thread> workers;
+    std::vector<std::exception_ptr> errors(kThreads);
+    for (long thread{0}; thread < kThreads; ++thread) {
+      const long kFirstRow{dimensions_[1] * thread / kThreads};
+      const long kRows{dimensions_[1] * (thread + 1) / kThreads - kFirstRow};
+      workers.emplace_back([&, thread, kFirstRow, kRows]() {
+        try {
+          write_band(kFirstRow, kRows);
+        } catch (...) {
+          errors[thread] = std::current_exception();
+        }
+      });
+    }
+    for (std::thread& worker : workers) {
+      worker.join();
+    }
+    for (std::exception_ptr& error : errors) {
+      if (error) {
+        std::rethrow_exception(error);
+      }
+    }
+  }
+  // Returns true if the sign bit of the pixels on disk has to be flipped,
+  // only 8-bit ones are unsigned.
+  inline bool FlipsSign() const {
+    return std::is_integral_v<T> && std::is_signed_v<T> != (bitpix_ != BYTE_IMG);
+  }
+  /**
+   * @brief Calculates the first row of a band when the image is split among
+   *  threads. Bands start at a row of tiles of compressed images, so no tile
+   *  is decompressed by two threads.
+   * @param band Index of the band, `bands` for the end of the image.
+   * @param bands Amount of bands.
+   * @returns The first row of the band.
+   */
+  long BandStart(long band, long bands) const {
+    if (band >= bands) {
+      return dimensions_[1];
+    }
+    return dimensions_[1] * band / bands / tile_rows_ * tile_rows_;
+  }
+  /**
+   * @brief Loads a band of rows into the padded array.
+   * @param mapped_data Mapped data unit of the image, nullptr to read the
+   *  rows with CFITSIO.
+   * @param fits_file CFITSIO handle to read with if there is no mapping.
+   * @param first_row First row of the band.
+   * @param amount Amount of rows of the band.
+   * @param flip_sign Flips the sign bit of the mapped pixels.
+   */
+  void LoadRows(const unsigned char* mapped_data, fitsfile* fits_file,
+                long first_row, long amount, bool flip_sign) {
+    T* image_data_pointer{image_data_ +
+                          (padding_ + first_row) * row_pitch_ +
+                          padding_};
+    if (mapped_data != nullptr) {
+      const std::size_t kRowBytes = file_dimensions_[0] * sizeof(T);
+      mapped_data += (region_start_[1] + first_row) * kRowBytes +
+                     region_start_[0] * sizeof(T);
+      for (long row{0};
+          row < amount;
+          image_data_pointer += row_pitch_,
+          mapped_data += kRowBytes,
+          ++row) {
+        FitsUtils::DecodeBigEndian(mapped_data, image_data_pointer,
+                                   dimensions_[0], flip_sign);
+      }
+      return;
+    }
+    int status{0};
+    if (tile_rows_ == 1) {
+      for (long row{0};
+          row < amount && status == 0;
+          image_data_pointer += row_pitch_, ++row) {
+        ReadImageRows(fits_file, first_row + row, 1, image_data_pointer, status);
+      }
+    } else {
+      // A whole row of tiles per read, each tile is decompressed once
+      std::vector<T> tile_row(std::min(tile_rows_, amount) * dimensions_[0]);
+      for (long row{0}; row < amount && status == 0; row += tile_rows_) {
+        const long kRows{std::min(tile_rows_, amount - row)};
+        ReadImageRows(fits_file, first_row + row, kRows, tile_row.data(), status);
+        for (long tile_row_index{0};
+            tile_row_index < kRows;
+            image_data_pointer += row_pitch_, ++tile_row_index) {
+          std::copy_n(tile_row.data() + tile_row_index * dimensions_[0],
+                      dimensions_[0], image_data_pointer);
+        }
+      }
+    }
+    if (status != 0) {
+      throw std::runtime_error("Reading the image from the FITS file failed.");
+    }
+  }
+  /**
+   * @brief Reads consecutive rows of the image with CFITSIO. Only the columns
+   *  of the region are read if there is one.
+   * @param fits_file CFITSIO handle to read with.
+   * @param first_row First row to read, relative to the region.
+   * @param amount Amount of rows to read.
+   * @param destination Where the rows are stored, without gaps.
+   * @param status CFITSIO status.
+   */
+  void ReadImageRows(fitsfile* fits_file, long first_row, long amount,
+                     T* destination, int& status) {
+    if (!has_region_) {
+      fits_read_img(fits_file, data_type_,
+                    PlaneOffset() + first_row * dimensions_[0] + 1,
+                    amount * dimensions_[0], nullptr, destination, nullptr,
+                    &status);
+      return;
+    }
+    long first_pixel[kAmountOfAxis + 1] = {region_start_[0] + 1,
+                                           region_start_[1] + first_row + 1,
+                                           plane_ + 1};
+    long last_pixel[kAmountOfAxis + 1] = {region_start_[0] + dimensions_[0],
+                                          region_start_[1] + first_row + amount,
+                                          plane_ + 1};
+    long increment[kAmountOfAxis + 1] = {1, 1, 1};
+    fits_read_subset(fits_file, data_type_, first_pixel, last_pixel, increment,
+                     nullptr, destination, nullptr, &status);
+  }
+  /**
+   * @brief Fills the padding around the loaded image, and the end of the rows
+   *  past the padding.
+   * @param filling Padding value.
+   */
+  void FillPadding(T filling) {
+    Trace::Scope scope{"padding",
+                       (padded_total_elements_ - total_elements_) * sizeof(T)};
+    const long kPaddingRows{padding_ * row_pitch_};
+    std::fill(image_data_, image_data_ + kPaddingRows, filling);
+    std::fill(image_data_ + padded_total_elements_ - kPaddingRows,
+              image_data_ + padded_total_elements_, filling);
+    T* row_pointer{image_data_ + kPaddingRows};
+    for (long row{0};
+        row < dimensions_[1];
+        row_pointer += row_pitch_, ++row) {
+      std::fill(row_pointer, row_pointer + padding_, filling);
+      std::fill(row_pointer + padding_ + dimensions_[0],
+                row_pointer + row_pitch_, filling);
+    }
+  }
+  // Frees the loaded image and the scratch one.
+  void FreeData() {
+    ::operator delete[](scratch_data_, std::align_val_t{kRowAlignment});
+    scratch_data_ = nullptr;
+    ::operator delete[](image_data_, std::align_val_t{kRowAlignment});
+    image_data_ = nullptr;
+  }
 
   T* image_data_;
+  // Second buffer of the operations, allocated on demand
+  T* scratch_data_;
 };
 
 /**
@@ -162,3 +518,11 @@ FitsImage* NewFitsImage(std::string file_name,
                         OpeningMode mode = OpeningMode::OPEN,
                         int creation_bitpix = FLOAT_IMG);
 
+/**
+ * @brief Creates a FITS image instance from an open FITS file using dynamic
+ *  memory. Is the user's responsibility to free the memory.
+ *  The image takes ownership of the file and closes it.
+ * @param fits_file FITS file pointer, at the image HDU to work with.
+ * @returns A TemplatedFitsImage object as its base class poiner.
+ */
+FitsImage* OpenFitsImage(fitsfile* fits_file);
@@ -13,6 +13,10 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
 
 #include "structuring_element.h"
 
@@ -77,8 +81,66 @@ class TemplatedStructuringElement: public StructuringElement {
       }
     }
   }
+  /**
+   * @brief Creates a structuring element from a mask in memory.
+   * @param mask Cells of the SE in row-major order, with the rows in the same
+   *  order as the rows of the image in memory. Non-zero cells are 1.
+   * @param rows Amount of rows of the SE.
+   * @param columns Amount of columns of the SE.
+   * @param center_row Row of the origin of the SE.
+   * @param center_column Column of the origin of the SE.
+   */
+  TemplatedStructuringElement(const unsigned char* mask, long rows, long columns,
+                              long center_row, long center_column):
+    StructuringElement{} {
+    if (rows <= 0 || columns <= 0 || center_row < 0 || center_row >= rows ||
+        center_column < 0 || center_column >= columns) {
+      throw std::invalid_argument("Invalid structuring element.");
+    }
+    rows_ = rows;
+    columns_ = columns;
+    center_row_ = center_row;
+    center_column_ = center_column;
+    total_elements_ = rows_ * columns_;
+    data_ = new T[total_elements_];
+    for (long cell{0}; cell < total_elements_; ++cell) {
+      data_[cell] = mask[cell] != 0 ? static_cast<T>(1) : static_cast<T>(0);
+    }
+  }
   ~TemplatedStructuringElement() override { delete[] data_; };
   inline T* GetData() { return data_; };
+  /**
+   * @brief Packs the cells of the SE into bits, in row-major order.
+   * @returns The packed mask, where bit `i` of word `w` is the cell `64 * w + i`.
+   */
+  std::vector<std::uint64_t> PackedMask() const {
+    std::vector<std::uint64_t> mask((total_elements_ + 63) / 64, 0);
+    const T kOneValue{static_cast<T>(1)};
+    for (long cell{0}; cell < total_elements_; ++cell) {
+      if (data_[cell] == kOneValue) {
+        mask[cell / 64] |= std::uint64_t{1} << (cell % 64);
+      }
+    }
+    return mask;
+  }
+  /**
+   * @brief Calculates a hash of the SE shape, origin and mask. Equal SEs have
+   *  the same hash, different ones may collide.
+   * @returns The hash value.
+   */
+  std::size_t Hash() const {
+    std::size_t hash{std::hash<long>{}(rows_)};
+    auto combine = [&hash](std::size_t value) {
+      hash ^= value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    };
+    combine(std::hash<long>{}(columns_));
+    combine(std::hash<long>{}(center_row_));
+    combine(std::hash<long>{}(center_column_));
+    for (std::uint64_t word : PackedMask()) {
+      combine(std::hash<std::uint64_t>{}(word));
+    }
+    return hash;
+  }
  private:
   T* data_;
 };
@@ -0,0 +1,100 @@
+/**
+ * @brief Timing of the phases of a job (reading, padding, transfers, kernels
+ *  and writing), exported as a Chrome trace.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Trace {
+  // Process ids of the trace, the host threads and the devices.
+  constexpr int kHostProcess = 0;
+  constexpr int kDeviceProcess = 1;
+
+  // True while the events are recorded, read by every scope.
+  inline std::atomic<bool> enabled{false};
+
+  // Tells if the events are being recorded.
+  inline bool Enabled() { return enabled.load(std::memory_order_relaxed); }
+
+  // Starts recording events, their times count from this call.
+  void Enable();
+
+  // Returns the nanoseconds elapsed since Enable().
+  std::int64_t Now();
+
+  // Returns a small id of the calling thread for the trace.
+  int ThreadId();
+
+  /**
+   * @brief Records a finished phase. Can be called from several threads.
+   * @param name Name of the phase, phases with the same name are added up in
+   *  the summary.
+   * @param start Start of the phase in nanoseconds, as given by Now().
+   * @param duration Duration of the phase in nanoseconds.
+   * @param bytes Bytes moved by the phase, 0 if it only computes.
+   * @param process kHostProcess or kDeviceProcess.
+   * @param thread Thread or device of the phase.
+   */
+  void AddEvent(const std::string& name, std::int64_t start,
+                std::int64_t duration, std::size_t bytes, int process,
+                int thread);
+
+  /**
+   * @brief Names the row of a thread or device in the trace. Can be called
+   *  from several threads.
+   * @param process kHostProcess or kDeviceProcess.
+   * @param thread Thread or device of the row.
+   * @param name Label of the row.
+   */
+  void NameRow(int process, int thread, const std::string& name);
+
+  /**
+   * @brief Writes the recorded events as a Chrome trace-event JSON file,
+   *  which chrome://tracing and Perfetto open. Throws an exception if the
+   *  file cannot be written.
+   * @param file_name The JSON file.
+   */
+  void Write(const std::string& file_name);
+
+  /**
+   * @brief Adds up the events of each phase.
+   * @returns A table with the time, bytes and GB/s of every phase.
+   */
+  std::string Summary();
+
+  /**
+   * @brief Records the time from its creation to its destruction as a phase
+   *  of the calling thread. Only reads a flag when tracing is disabled.
+   */
+  class Scope {
+   public:
+    /**
+     * @param name Name of the phase, must outlive the scope.
+     * @param bytes Bytes moved by the phase.
+     */
+    explicit Scope(const char* name, std::size_t bytes = 0):
+        name_{Enabled() ? name : nullptr}, bytes_{bytes},
+        start_{name_ != nullptr ? Now() : 0} {}
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+    ~Scope() {
+      if (name_ != nullptr) {
+        AddEvent(name_, start_, Now() - start_, bytes_, kHostProcess,
+                 ThreadId());
+      }
+    }
+    // Sets the bytes moved once they are known.
+    inline void SetBytes(std::size_t bytes) { bytes_ = bytes; }
+   private:
+    const char* name_;
+    std::size_t bytes_;
+    std::int64_t start_;
+  };
+}
@@ -0,0 +1,104 @@
+/**
+ * @brief Timing of the SYCL command groups with the profiling of their
+ *  events, added to the trace of the job.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sycl/sycl.hpp>
+
+#include "trace.h"
+
+namespace Trace {
+  /**
+   * @brief Gives the properties of the engine queues, with profiling while
+   *  tracing. Queues are created without profiling otherwise, so it costs
+   *  nothing when disabled.
+   * @returns The queue properties.
+   */
+  inline sycl::property_list QueueProperties() {
+    if (Enabled()) {
+      return sycl::property_list{sycl::property::queue::enable_profiling{}};
+    }
+    return sycl::property_list{};
+  }
+
+  /**
+   * @brief A command group of a device and the bytes it moves.
+   */
+  struct DeviceCommand {
+    const char* name;
+    sycl::event event;
+    std::size_t bytes;
+  };
+
+  /**
+   * @brief Gives a small id of a device for the trace, naming its row the
+   *  first time. Sub-devices and identical devices, which share their name,
+   *  get their own rows, told apart by the id in the label.
+   * @param device The device.
+   * @returns The id of the device.
+   */
+  inline int DeviceId(const sycl::device& device) {
+    static std::mutex mutex;
+    static std::unordered_map<sycl::device, int> ids;
+    std::lock_guard<std::mutex> lock{mutex};
+    auto [id, inserted] = ids.emplace(device, static_cast<int>(ids.size()));
+    if (inserted) {
+      NameRow(kDeviceProcess, id->second, std::to_string(id->second) + ": " +
+              device.get_info<sycl::info::device::name>());
+    }
+    return id->second;
+  }
+
+  /**
+   * @brief Records finished command groups with their device times. The
+   *  device clock is moved to the host one so the last command ends now, so
+   *  it must be called right after waiting for them. Commands of queues
+   *  without profiling are skipped.
+   * @param device Device the commands ran on.
+   * @param commands The finished commands.
+   */
+  inline void AddDeviceCommands(const sycl::device& device,
+                                const std::vector<DeviceCommand>& commands) {
+    if (!Enabled() || commands.empty()) {
+      return;
+    }
+    struct Times {
+      std::uint64_t start;
+      std::uint64_t end;
+    };
+    std::vector<Times> times;
+    try {
+      for (const DeviceCommand& command : commands) {
+        times.push_back({
+          command.event.get_profiling_info<
+            sycl::info::event_profiling::command_start>(),
+          command.event.get_profiling_info<
+            sycl::info::event_profiling::command_end>()});
+      }
+    } catch (const sycl::exception&) {
+      return;
+    }
+    std::uint64_t last_end{0};
+    for (const Times& command_times : times) {
+      last_end = std::max(last_end, command_times.end);
+    }
+    const std::int64_t kOffset{Now() - static_cast<std::int64_t>(last_end)};
+    const int kDevice{DeviceId(device)};
+    for (std::size_t index{0}; index < commands.size(); ++index) {
+      AddEvent(commands[index].name,
+               static_cast<std::int64_t>(times[index].start) + kOffset,
+               static_cast<std::int64_t>(times[index].end - times[index].start),
+               commands[index].bytes, kDeviceProcess, kDevice);
+    }
+  }
+}
@@ -6,33 +6,214 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
-class Morphology;
+#include "morphology.h"
+
+class StreamingMorphology;
+class MorphologyChain;
 enum class PaddingType;
 
 namespace Text {
   const std::string kUsage{
-    "Usage: ./morphology <fits_file> <se_file> <output_file> <operation>\n"
+    "Usage: ./morphology [options] <fits_file> <se_file> <output_file> <operation> [threshold_type]\n"
+    "       ./morphology [options] --serve[=socket]\n"
+    "       ./morphology [options] --batch <manifest>\n"
     "Type './morphology -h' for help."
   };
   const std::string kHelp{
-    "Usage: ./morphology <fits_file> <se_file> <output_file> <operation>\n"
+    "Usage: ./morphology [options] <fits_file> <se_file> <output_file> <operation> [threshold_type]\n"
+    "       ./morphology [options] --serve[=socket]\n"
+    "       ./morphology [options] --batch <manifest>\n"
     "Performs morphological operations on a binary image using a structuring element.\n"
     "Arguments:\n"
     "  <fits_file>      - The input FITS file.\n"
-    "  <se_file>        - The structuring element file.\n"
+    "  <se_file>        - The structuring element file, a comma-separated list\n"
+    "                     with one file per operation for a chain.\n"
     "  <output_file>    - The output FITS file to be created.\n"
-    "  <operation>      - The morphological operation to perform (single letter).\n"
-    "      Options: (e)rosion."
+    "  <operation>      - The morphological operation to perform (single letter),\n"
+    "                     or several letters for a chain of them.\n"
+    "      Options: (e)rosion, (d)ilation, (r)econstruction (opening by).\n"
+    "  [threshold_type] - Transforms the image to binary before the operation\n"
+    "                     (single letter). Grayscale if omitted.\n"
+    "      Options: (m)edian, (a)verage.\n"
+    "Options:\n"
+    "  --hetero         - Splits the image among every SYCL device and the host\n"
+    "                     CPU (SYCL build only).\n"
+    "  --stream[=rows]  - Streams the image in strips of rows, overlapping reads,\n"
+    "                     erosion (on the device in the SYCL build) and writes.\n"
+    "                     Default strip is 512 rows.\n"
+    "  --max-memory=SIZE\n"
+    "                   - Streams the image in the tallest strips whose buffers\n"
+    "                     fit in SIZE bytes (K, M and G suffixes allowed).\n"
+    "  --pool-memory=SIZE\n"
+    "                   - Device and pinned memory kept for reuse between\n"
+    "                     operations (SYCL build only). Default is 2G.\n"
+    "  --io-threads=N   - Loads and writes the image with N threads, each one\n"
+    "                     handles a band of rows (loading needs a reentrant\n"
+    "                     CFITSIO unless the image is uncompressed).\n"
+    "                     Default is 1.\n"
+    "  --plane-threads=N\n"
+    "                   - Transforms N planes at once when the input is a cube\n"
+    "                     or has several image extensions. Default is one per\n"
+    "                     core with a reentrant CFITSIO, 1 otherwise.\n"
+    "  --roi=REGION     - Only reads, transforms and writes a region, either a\n"
+    "                     FITS section x1:x2,y1:y2 or a box x,y,width,height\n"
+    "                     centered on pixel (x,y), both starting at 1.\n"
+    "  --compress[=type]\n"
+    "                   - Writes the output tile-compressed, type is one of\n"
+    "                     rice (default), gzip or hcompress. Floating point\n"
+    "                     images are always written losslessly with gzip.\n"
+    "  --trace=FILE     - Writes the time of every phase (open, load, padding,\n"
+    "                     operation, transfers, kernels and write) as a Chrome\n"
+    "                     trace-event JSON file, and prints their totals.\n"
+    "  --perf[=EVENT]   - Counts cycles, instructions and last level cache\n"
+    "                     misses of every operation with perf_event_open, and\n"
+    "                     the raw hexadecimal EVENT as vector instructions.\n"
+    "  --serve[=socket] - Runs as a server that takes jobs from a Unix socket\n"
+    "                     (default morph.sock), one per line with the arguments\n"
+    "                     separated by tabs. Engines, kernels and SEs are kept\n"
+    "                     between jobs. The line 'shutdown' stops it.\n"
+    "  --serve-workers=N\n"
+    "                   - Jobs the server runs at once. Default is 1, always 1\n"
+    "                     with --hetero.\n"
+    "  --serve-queue=N  - Jobs waiting at most, clients wait when it is full.\n"
+    "                     Default is 64.\n"
+    "  --batch          - Runs the jobs of a manifest, one per line with the\n"
+    "                     arguments separated by blanks, loading, operating\n"
+    "                     and writing several images at once.\n"
+    "  --batch-threads=L,C,W\n"
+    "                   - Threads that load, operate and write in batch mode.\n"
+    "                     Default is 2, one per core and 2. The operating\n"
+    "                     threads are always 1 with --hetero.\n"
+    "  --batch-queue=N  - Images waiting at most between two stages in batch\n"
+    "                     mode. Default is 4."
   };
   const std::string kInvalidOperation{
-    "Invalid operation. Use one of the following: (e)rosion."
+    "Invalid operation. Use one of the following: (e)rosion, (d)ilation, "
+    "(r)econstruction."
   };
 }
 
+/**
+ * @brief Rectangle of pixels of an image, starting at 0.
+ */
+struct PixelBox {
+  long first_column{0};
+  long first_row{0};
+  long columns{0};
+  long rows{0};
+};
+
+/**
+ * @brief Command line arguments of the program.
+ */
+struct Options {
+  std::string image_file_name;
+  std::string sel_file_name;
+  std::string output_file_name;
+  std::string operation;
+  ThresholdType threshold_type{ThresholdType::NONE};
+  // Splits the image among every available engine
+  bool heterogeneous{false};
+  // Rows of each strip when streaming the image, 0 to load it whole
+  long strip_rows{0};
+  // Memory budget in bytes that the strips are sized for, 0 if there is none
+  std::size_t max_memory{0};
+  // Idle device memory kept by the SYCL pool, 0 for its default
+  std::size_t pool_memory{0};
+  // Threads that load the image, each with its own CFITSIO handle
+  int io_threads{1};
+  // Planes transformed at once in cubes and multi-extension files, 0 to pick
+  int plane_threads{0};
+  // Region of interest, without columns to transform the whole image
+  PixelBox roi;
+  // CFITSIO compression algorithm of the output, 0 to write it uncompressed
+  int compression_type{0};
+  // Chrome trace of the phases, empty to not trace them
+  std::string trace_file_name;
+  // Collects the hardware counters of the operations
+  bool perf{false};
+  // Raw perf event counted as vector instructions, 0 for none
+  std::uint64_t perf_vector_event{0};
+  // Unix socket the server takes jobs from, empty to run a single job
+  std::string serve_socket;
+  // Jobs the server runs at once
+  int serve_workers{1};
+  // Jobs waiting in the server at most
+  int serve_queue{64};
+  // Manifest of jobs run as a batch, empty to run a single job
+  std::string batch_file_name;
+  // Threads of the load, compute and write stages of a batch, 0 to pick
+  int batch_load_threads{2};
+  int batch_compute_threads{0};
+  int batch_write_threads{2};
+  // Images waiting at most between two stages of a batch
+  int batch_queue{4};
+};
+
+// Socket of the server without an explicit path.
+const std::string kDefaultServeSocket{"morph.sock"};
+
+// Rows of each strip when streaming without an explicit amount.
+constexpr long kDefaultStripRows = 512;
+
+/**
+ * @brief Reads the command line arguments. Options start with `--` and can be
+ *  placed anywhere, the rest of the arguments are read in order. There are
+ *  none when serving, the jobs bring them, and only the manifest in batch
+ *  mode.
+ * @param argc The number of arguments.
+ * @param argv The arguments.
+ * @param options Where the arguments are stored.
+ * @returns False if the arguments do not match the usage, true otherwise.
+ */
+bool ParseArguments(int argc, char* argv[], Options& options);
+
+/**
+ * @brief Transforms a compression name into the CFITSIO compression type.
+ *  Throws an exception if the compression is not supported.
+ * @param compression Name of the compression: rice, gzip or hcompress.
+ * @returns The CFITSIO compression type.
+ */
+int GetCompressionType(const std::string& compression);
+
+/**
+ * @brief Reads a region of an image, a FITS section `x1:x2,y1:y2` (brackets
+ *  allowed) or a box `x,y,width,height` centered on pixel (x,y), with pixels
+ *  starting at 1 as in FITS. Throws an exception if the region is not valid.
+ * @param region Region to read.
+ * @returns The region as a box of pixels starting at 0.
+ */
+PixelBox ParseRegion(std::string region);
+
+/**
+ * @brief Reads a memory size, in bytes or with a K, M or G suffix (powers of
+ *  1024). Throws an exception if the size is not valid.
+ * @param size Size to read, such as `512M`.
+ * @returns The size in bytes.
+ */
+std::size_t ParseMemorySize(const std::string& size);
+
 inline double NanosecondsToSeconds(int64_t time) { return time * 1e-9; }
 
+/**
+ * @brief Keeps the kernels the SYCL runtime builds in its on-disk cache, so
+ *  later runs load them instead of building them again. Must be called before
+ *  any SYCL call. Does nothing without SYCL or if the user already chose with
+ *  SYCL_CACHE_PERSISTENT.
+ */
+void EnablePersistentKernelCache();
+
+/**
+ * @brief Limits the device and pinned host memory the SYCL pool keeps idle
+ *  for later operations. Does nothing without SYCL.
+ * @param bytes Bytes kept idle at most.
+ */
+void SetDevicePoolLimit(std::size_t bytes);
+
 /**
  * @brief Creates the corresponding Morphology operation.
  *  Throws an exception if the operation does not exist.
@@ -41,6 +222,66 @@ inline double NanosecondsToSeconds(int64_t time) { return time * 1e-9; }
  */
 Morphology* GetMorphologyOperation(std::string operation, int data_type);
 
+/**
+ * @brief Creates the chain of morphology operations, one per letter of the
+ *  user's input, each with its own structuring element. The threshold is
+ *  only applied before the first operation. Throws an exception if an
+ *  operation does not exist or there is not one SE file per operation.
+ * @param operations User's input for the operations.
+ * @param sel_file_names Comma-separated SE files, one per operation.
+ * @param data_type The type of data it operates with.
+ * @param heterogeneous Splits the erosions among every engine.
+ * @param threshold_type Threshold of the first operation.
+ * @returns The chain of operations.
+ */
+MorphologyChain* NewMorphologyChain(const std::string& operations,
+                                    const std::string& sel_file_names,
+                                    int data_type, bool heterogeneous,
+                                    ThresholdType threshold_type);
+
+/**
+ * @brief Creates the corresponding Morphology operation, split among every
+ *  SYCL device and the host CPU. Throws an exception if the operation does
+ *  not exist or the program was built without SYCL.
+ * @param operation User's input for the operation.
+ * @returns The morphology operation as its base class pointer.
+ */
+Morphology* GetHeterogeneousOperation(std::string operation, int data_type);
+
+/**
+ * @brief Creates the corresponding streaming Morphology operation.
+ *  Throws an exception if the operation does not exist or cannot be streamed.
+ * @param operation User's input for the operation.
+ * @returns The streaming morphology operation as its base class pointer.
+ */
+StreamingMorphology* GetStreamingOperation(std::string operation,
+                                           int data_type);
+
+/**
+ * @brief Tells if each pixel of the result only depends on its neighbourhood
+ *  under the SEs, so the operations can be restricted to a region.
+ *  Throws an exception if an operation does not exist.
+ * @param operation User's input for the operations, one letter each.
+ * @returns True if every operation is local, false otherwise.
+ */
+bool IsLocalOperation(std::string operation);
+
+/**
+ * @brief Returns the threshold type from the user's input.
+ *  Throws an exception if the threshold does not exist.
+ * @param threshold User's input for the threshold.
+ * @returns The threshold type.
+ */
+ThresholdType GetThresholdType(std::string threshold);
+
+/**
+ * @brief Returns the name of an operation for the traces and counters.
+ *  Throws an exception if the operation does not exist.
+ * @param operation User's input for the operation.
+ * @returns The name of the operation, such as erode.
+ */
+std::string GetOperationName(std::string operation);
+
 /**
  * @brief Returns the filling type depending on the morphology operation.
  * @param operation User's input for the operation.
@@ -0,0 +1,238 @@
+/**
+ * @brief BatchScheduler class that transforms the FITS files of a manifest,
+ *  loading, operating and writing several of them at once.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#include "../include/batch_scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "../include/fits_batch.h"
+#include "../include/fits_utils.h"
+#include "../include/morphology_chain.h"
+#include "../include/templated_fits_image.h"
+
+namespace {
+  // Returns the seconds elapsed since a time point.
+  double SecondsSince(std::chrono::steady_clock::time_point start_time) {
+    return NanosecondsToSeconds(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start_time).count());
+  }
+}
+
+BatchScheduler::BatchScheduler(const Options& options, int load_threads,
+                               int compute_threads, int write_threads,
+                               std::size_t queue_capacity):
+    options_{options}, load_threads_{std::max(load_threads, 1)},
+    compute_threads_{std::max(compute_threads, 1)},
+    write_threads_{std::max(write_threads, 1)},
+    chains_{options.heterogeneous}, loaded_{queue_capacity},
+    operated_{queue_capacity} {}
+
+long BatchScheduler::Run(const std::string& manifest_file_name,
+                         std::ostream& summary) {
+  jobs_ = ReadManifest(manifest_file_name);
+  results_.assign(jobs_.size(), Result{});
+  next_job_ = 0;
+  auto start_time = std::chrono::steady_clock::now();
+  std::vector<std::thread> loaders;
+  std::vector<std::thread> computers;
+  std::vector<std::thread> writers;
+  for (int thread{0}; thread < load_threads_; ++thread) {
+    loaders.emplace_back(&BatchScheduler::Load, this);
+  }
+  for (int thread{0}; thread < compute_threads_; ++thread) {
+    computers.emplace_back(&BatchScheduler::Compute, this);
+  }
+  for (int thread{0}; thread < write_threads_; ++thread) {
+    writers.emplace_back(&BatchScheduler::Write, this);
+  }
+  // Each stage ends once the previous one has handed over every image
+  for (std::thread& loader : loaders) {
+    loader.join();
+  }
+  loaded_.Close();
+  for (std::thread& computer : computers) {
+    computer.join();
+  }
+  operated_.Close();
+  for (std::thread& writer : writers) {
+    writer.join();
+  }
+  const double kSeconds{SecondsSince(start_time)};
+
+  long failed{0};
+  double pixels{0};
+  double load_seconds{0};
+  double compute_seconds{0};
+  double write_seconds{0};
+  summary << std::fixed << std::setprecision(3);
+  for (std::size_t index{0}; index < jobs_.size(); ++index) {
+    const Result& result = results_[index];
+    summary << jobs_[index].output_file_name << ": ";
+    if (!result.error.empty()) {
+      ++failed;
+      summary << "error, " << result.error << "\n";
+      continue;
+    }
+    summary << "load " << result.load_seconds << " s, operation "
+            << result.compute_seconds << " s, write " << result.write_seconds
+            << " s\n";
+    pixels += result.pixels;
+    load_seconds += result.load_seconds;
+    compute_seconds += result.compute_seconds;
+    write_seconds += result.write_seconds;
+  }
+  const long kDone{static_cast<long>(jobs_.size()) - failed};
+  summary << "Batch: " << kDone << " jobs done, " << failed << " failed in "
+          << kSeconds << " s, " << kDone / std::max(kSeconds, 1e-9)
+          << " jobs/s, " << pixels / std::max(kSeconds, 1e-9) * 1e-6
+          << " Mpixels/s\n"
+          << "Stage time: load " << load_seconds << " s, operation "
+          << compute_seconds << " s, write " << write_seconds << " s\n";
+  return failed;
+}
+
+std::vector<BatchScheduler::Job> BatchScheduler::ReadManifest(
+    const std::string& manifest_file_name) {
+  std::ifstream manifest{manifest_file_name};
+  if (!manifest) {
+    throw std::runtime_error("The manifest " + manifest_file_name +
+                             " could not be opened.");
+  }
+  std::vector<Job> jobs;
+  std::string line;
+  long line_number{0};
+  while (std::getline(manifest, line)) {
+    ++line_number;
+    std::vector<std::string> fields;
+    std::istringstream stream{line};
+    std::string field;
+    while (stream >> field) {
+      fields.push_back(field);
+    }
+    if (fields.empty() || fields[0][0] == '#') {
+      continue;
+    }
+    if (fields.size() != 4 && fields.size() != 5) {
+      throw std::invalid_argument("Line " + std::to_string(line_number) +
+                                  " of the manifest is not a job.");
+    }
+    Job job;
+    job.image_file_name = fields[0];
+    job.sel_file_name = fields[1];
+    job.output_file_name = fields[2];
+    job.operation = fields[3];
+    if (fields.size() == 5) {
+      job.threshold_type = GetThresholdType(fields[4]);
+    }
+    jobs.push_back(job);
+  }
+  return jobs;
+}
+
+void BatchScheduler::Load() {
+  for (std::size_t index{next_job_++}; index < jobs_.size();
+       index = next_job_++) {
+    const Job& job = jobs_[index];
+    Result& result = results_[index];
+    auto start_time = std::chrono::steady_clock::now();
+    auto task = std::make_unique<Task>();
+    task->job = index;
+    try {
+      std::unique_lock<std::mutex> lock{
+        FitsUtils::LockUnlessReentrant(fits_mutex_)};
+      auto batch = std::make_unique<FitsBatch>(job.image_file_name);
+      if (batch->Planes() > 1) {
+        if (options_.compression_type != 0) {
+          throw std::invalid_argument("Cubes and multi-extension files cannot "
+                                      "be written compressed.");
+        }
+        task->batch = std::move(batch);
+      } else {
+        task->image.reset(NewFitsImage(job.image_file_name));
+        task->image->SetIoThreads(options_.io_threads);
+        task->image->SetCompression(options_.compression_type);
+        task->chain = chains_.Get(job.operation, job.sel_file_name,
+                                  task->image->GetDataType(),
+                                  job.threshold_type);
+        task->image->Load(task->chain->Padding(), task->chain->Filling());
+        result.pixels = static_cast<double>(task->image->Rows()) *
+                        task->image->Columns();
+      }
+    } catch (const std::exception& error) {
+      result.error = error.what();
+      std::unique_lock<std::mutex> lock{
+        FitsUtils::LockUnlessReentrant(fits_mutex_)};
+      task.reset();
+      continue;
+    }
+    result.load_seconds = SecondsSince(start_time);
+    loaded_.Push(std::move(task));
+  }
+}
+
+void BatchScheduler::Compute() {
+  std::unique_ptr<Task> task;
+  while (loaded_.Pop(task)) {
+    const Job& job = jobs_[task->job];
+    Result& result = results_[task->job];
+    auto start_time = std::chrono::steady_clock::now();
+    try {
+      if (task->batch) {
+        auto new_chain = [&](int data_type) {
+          return chains_.Get(job.operation, job.sel_file_name, data_type,
+                             job.threshold_type);
+        };
+        // The whole file is read, transformed and written here
+        std::unique_lock<std::mutex> lock{
+        FitsUtils::LockUnlessReentrant(fits_mutex_)};
+        task->batch->Apply(new_chain, job.output_file_name, 1,
+                           options_.io_threads);
+      } else {
+        task->image->SetMorphology(task->chain.get());
+        task->image->ApplyMorphology(nullptr);
+      }
+    } catch (const std::exception& error) {
+      result.error = error.what();
+      std::unique_lock<std::mutex> lock{
+        FitsUtils::LockUnlessReentrant(fits_mutex_)};
+      task.reset();
+      continue;
+    }
+    result.compute_seconds = SecondsSince(start_time);
+    operated_.Push(std::move(task));
+  }
+}
+
+void BatchScheduler::Write() {
+  std::unique_ptr<Task> task;
+  while (operated_.Pop(task)) {
+    const Job& job = jobs_[task->job];
+    Result& result = results_[task->job];
+    auto start_time = std::chrono::steady_clock::now();
+    {
+      std::unique_lock<std::mutex> lock{
+        FitsUtils::LockUnlessReentrant(fits_mutex_)};
+      try {
+        if (task->image) {
+          task->image->WriteToFile(job.output_file_name);
+        }
+      } catch (const std::exception& error) {
+        result.error = error.what();
+      }
+      // Closes the input file
+      task.reset();
+    }
+    result.write_seconds = SecondsSince(start_time);
+  }
+}
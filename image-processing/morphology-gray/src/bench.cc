@@ -0,0 +1,653 @@
+/**
+ * @brief This program benchmarks the morphology engines on synthetic FITS
+ * images and structuring elements, and compares the results with a baseline.
+ *
+ * @author: Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fitsio.h>
+
+#include "../include/templated_fits_image.h"
+#include "../include/templated_structuring_element.h"
+#include "../include/streaming_morphology.h"
+#include "../include/morphology_chain.h"
+#include "../include/perf_counters.h"
+#include "../include/synthetic.h"
+#include "../include/utils.h"
+
+namespace {
+  const std::string kBenchHelp{
+    "Usage: ./morph_bench [options]\n"
+    "Times the morphology engines on synthetic images, which are generated in\n"
+    "the work directory the first time they are needed.\n"
+    "Options (lists are comma-separated):\n"
+    "  --work-dir=DIR       - Synthetic files and outputs. Default is bench.\n"
+    "  --sizes=LIST         - Columns and rows of the images. Default is 1024.\n"
+    "  --types=LIST         - Pixel types: u8, i8, i16, u16, i32, u32, i64, f32\n"
+    "                         and f64. Default is all of them.\n"
+    "  --patterns=LIST      - gradient, noise and stars. Default is all of them.\n"
+    "  --sels=LIST          - SE shapes: square, cross, disk and line.\n"
+    "                         Default is square,disk.\n"
+    "  --sel-sizes=LIST     - Odd SE sizes. Default is 3,15.\n"
+    "  --engines=LIST       - erode, dilate, reconstruct, stream-erode and\n"
+    "                         hetero-erode (SYCL build only). Default is every\n"
+    "                         available one.\n"
+    "  --threads=LIST       - I/O threads that load and write the images.\n"
+    "                         Default is 1 and one per core.\n"
+    "  --warmup=N           - Untimed runs before each case. Default is 1.\n"
+    "  --repetitions=N      - Timed runs of each case. Default is 5.\n"
+    "  --json=FILE          - Results as JSON. Default is <work-dir>/results.json.\n"
+    "  --csv=FILE           - Results as CSV. Default is <work-dir>/results.csv.\n"
+    "  --baseline=FILE      - CSV of a previous run to compare with.\n"
+    "  --tolerance=FRACTION - Slowdown allowed before a case is flagged as a\n"
+    "                         regression, never less than the spread of the\n"
+    "                         case. Default is 0.1.\n"
+    "  --perf[=EVENT]       - Counts the hardware events of the timed runs with\n"
+    "                         perf_event_open, and the raw hexadecimal EVENT\n"
+    "                         as vector instructions."
+  };
+
+  /**
+   * @brief Command line arguments of the benchmark.
+   */
+  struct BenchOptions {
+    std::string work_dir{"bench"};
+    std::vector<std::string> sizes{"1024"};
+    std::vector<std::string> types{"u8", "i8", "i16", "u16", "i32", "u32",
+                                   "i64", "f32", "f64"};
+    std::vector<std::string> patterns{"gradient", "noise", "stars"};
+    std::vector<std::string> sels{"square", "disk"};
+    std::vector<std::string> sel_sizes{"3", "15"};
+    std::vector<std::string> engines;
+    std::vector<std::string> threads;
+    int warmup{1};
+    int repetitions{5};
+    std::string json_file_name;
+    std::string csv_file_name;
+    std::string baseline_file_name;
+    double tolerance{0.1};
+    bool perf{false};
+    std::uint64_t perf_vector_event{0};
+  };
+
+  /**
+   * @brief How an engine transforms the images.
+   */
+  enum class EngineMode {
+    LOADED, // Loads the image and applies the operation in memory
+    HETEROGENEOUS, // Like LOADED, split among every device and the host
+    STREAMED // Streams the image in strips straight to the output
+  };
+
+  /**
+   * @brief A morphology engine to benchmark.
+   */
+  struct Engine {
+    std::string name;
+    std::string operation;
+    EngineMode mode;
+  };
+
+  /**
+   * @brief A benchmark case, identified by its key.
+   */
+  struct Case {
+    Engine engine;
+    std::string pattern;
+    std::string type;
+    long size;
+    std::string sel;
+    long sel_size;
+    int threads;
+    std::string Key() const {
+      std::ostringstream key;
+      key << engine.name << "," << pattern << "," << type << "," << size << ","
+          << sel << "," << sel_size << "," << threads;
+      return key.str();
+    }
+  };
+
+  /**
+   * @brief Timings of the repetitions of a case.
+   */
+  struct Result {
+    Case bench_case;
+    double median_seconds;
+    double min_seconds;
+    double max_seconds;
+    // Range of the repetitions relative to the median
+    double spread;
+    double pixels_per_second;
+    // Load, operation and write
+    double median_total_seconds;
+    // Hardware counters of the timed operations
+    Perf::Counts counts;
+    // Why the case could not run, empty if it ran
+    std::string error;
+  };
+
+  const std::string kCsvHeader{
+    "engine,pattern,type,size,sel,sel_size,threads,repetitions,"
+    "median_seconds,min_seconds,max_seconds,spread,pixels_per_second,"
+    "median_total_seconds,cycles_per_pixel,instructions_per_pixel,ipc,"
+    "llc_bytes_per_pixel,vector_per_pixel,error"
+  };
+  // Columns of the CSV files the baselines are read from, older ones included.
+  const std::string kCsvBaselineColumns{
+    "engine,pattern,type,size,sel,sel_size,threads,repetitions,"
+    "median_seconds,min_seconds,max_seconds,spread,pixels_per_second"
+  };
+
+  // Splits a comma-separated list, without the empty items.
+  std::vector<std::string> SplitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream{list};
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+      if (!item.empty()) {
+        items.push_back(item);
+      }
+    }
+    return items;
+  }
+
+  /**
+   * @brief Returns the CFITSIO image type of a pixel type name.
+   *  Throws an exception if the type does not exist.
+   * @param type Name of the pixel type, such as u16.
+   * @returns The image type, such as USHORT_IMG.
+   */
+  int GetImageType(const std::string& type) {
+    const std::map<std::string, int> kImageTypes{
+      {"u8", BYTE_IMG}, {"i8", SBYTE_IMG}, {"i16", SHORT_IMG},
+      {"u16", USHORT_IMG}, {"i32", LONG_IMG}, {"u32", ULONG_IMG},
+      {"i64", LONGLONG_IMG}, {"f32", FLOAT_IMG}, {"f64", DOUBLE_IMG}
+    };
+    auto image_type = kImageTypes.find(type);
+    if (image_type == kImageTypes.end()) {
+      throw std::invalid_argument("Pixel type not supported: " + type);
+    }
+    return image_type->second;
+  }
+
+  // Returns the engines of this build.
+  std::vector<Engine> AvailableEngines() {
+    std::vector<Engine> engines{
+      {"erode", "e", EngineMode::LOADED},
+      {"dilate", "d", EngineMode::LOADED},
+      {"reconstruct", "r", EngineMode::LOADED},
+      {"stream-erode", "e", EngineMode::STREAMED}
+    };
+#ifdef USE_SYCL
+    engines.push_back({"hetero-erode", "e", EngineMode::HETEROGENEOUS});
+#endif
+    return engines;
+  }
+
+  /**
+   * @brief Reads the command line arguments.
+   * @param argc The number of arguments.
+   * @param argv The arguments.
+   * @param options Where the arguments are stored.
+   * @returns False if the arguments do not match the usage, true otherwise.
+   */
+  bool ParseBenchArguments(int argc, char* argv[], BenchOptions& options) {
+    const std::map<std::string, std::vector<std::string>*> kLists{
+      {"--sizes=", &options.sizes}, {"--types=", &options.types},
+      {"--patterns=", &options.patterns}, {"--sels=", &options.sels},
+      {"--sel-sizes=", &options.sel_sizes}, {"--engines=", &options.engines},
+      {"--threads=", &options.threads}
+    };
+    for (int index{1}; index < argc; ++index) {
+      const std::string kArgument{argv[index]};
+      const std::size_t kEquals{kArgument.find('=')};
+      const std::string kName{kArgument.substr(0, kEquals + 1)};
+      const std::string kValue{kEquals == std::string::npos ?
+                               "" : kArgument.substr(kEquals + 1)};
+      if (kLists.count(kName) > 0) {
+        *kLists.at(kName) = SplitList(kValue);
+      } else if (kName == "--work-dir=") {
+        options.work_dir = kValue;
+      } else if (kName == "--warmup=") {
+        options.warmup = std::stoi(kValue);
+      } else if (kName == "--repetitions=") {
+        options.repetitions = std::stoi(kValue);
+      } else if (kName == "--json=") {
+        options.json_file_name = kValue;
+      } else if (kName == "--csv=") {
+        options.csv_file_name = kValue;
+      } else if (kName == "--baseline=") {
+        options.baseline_file_name = kValue;
+      } else if (kName == "--tolerance=") {
+        options.tolerance = std::stod(kValue);
+      } else if (kArgument == "--perf") {
+        options.perf = true;
+      } else if (kName == "--perf=") {
+        options.perf = true;
+        options.perf_vector_event = std::stoull(kValue, nullptr, 16);
+      } else {
+        return false;
+      }
+    }
+    if (options.threads.empty()) {
+      options.threads.push_back("1");
+      const unsigned kCores{std::thread::hardware_concurrency()};
+      if (kCores > 1) {
+        options.threads.push_back(std::to_string(kCores));
+      }
+    }
+    if (options.json_file_name.empty()) {
+      options.json_file_name = options.work_dir + "/results.json";
+    }
+    if (options.csv_file_name.empty()) {
+      options.csv_file_name = options.work_dir + "/results.csv";
+    }
+    return options.warmup >= 0 && options.repetitions > 0 &&
+           options.tolerance >= 0.0;
+  }
+
+  /**
+   * @brief Runs a case once.
+   * @param bench_case The case to run.
+   * @param image_file_name Synthetic image of the case.
+   * @param output_file_name Output FITS file, overwritten.
+   * @param chain Operation of the LOADED and HETEROGENEOUS engines.
+   * @param stream Operation of the STREAMED engines.
+   * @param sel Structuring element of the STREAMED engines.
+   * @param perf_phase Phase the hardware counters of the operation are added
+   *  to, nullptr to not count them.
+   * @param total_seconds Where the time of the whole run is stored.
+   * @returns The time of the operation in seconds.
+   */
+  double RunOnce(const Case& bench_case, const std::string& image_file_name,
+                 const std::string& output_file_name, MorphologyChain* chain,
+                 StreamingMorphology* stream, StructuringElement* sel,
+                 const char* perf_phase, double& total_seconds) {
+    const double kPixels{static_cast<double>(bench_case.size) * bench_case.size};
+    auto start_time = std::chrono::steady_clock::now();
+    std::unique_ptr<FitsImage> image{NewFitsImage(image_file_name)};
+    image->SetIoThreads(bench_case.threads);
+    std::chrono::steady_clock::time_point start_operation_time;
+    std::chrono::steady_clock::time_point end_operation_time;
+    if (bench_case.engine.mode == EngineMode::STREAMED) {
+      const long kStripRows{std::min(kDefaultStripRows, image->Rows())};
+      Perf::Scope perf_scope{perf_phase, kPixels};
+      start_operation_time = std::chrono::steady_clock::now();
+      stream->Stream(image.get(), sel, output_file_name, kStripRows);
+      end_operation_time = std::chrono::steady_clock::now();
+    } else {
+      image->Load(chain->Padding(), chain->Filling());
+      image->SetMorphology(chain);
+      {
+        Perf::Scope perf_scope{perf_phase, kPixels};
+        start_operation_time = std::chrono::steady_clock::now();
+        image->ApplyMorphology(nullptr);
+        end_operation_time = std::chrono::steady_clock::now();
+      }
+      image->WriteToFile(output_file_name);
+    }
+    image.reset();
+    auto end_time = std::chrono::steady_clock::now();
+    total_seconds = NanosecondsToSeconds(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+        end_time - start_time).count());
+    return NanosecondsToSeconds(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+        end_operation_time - start_operation_time).count());
+  }
+
+  // Returns the median of the values.
+  double Median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    const std::size_t kMiddle{values.size() / 2};
+    return values.size() % 2 == 1 ?
+           values[kMiddle] : (values[kMiddle - 1] + values[kMiddle]) / 2.0;
+  }
+
+  /**
+   * @brief Warms up and times a case. The operation and its SE are built
+   *  once, so the repetitions reuse the device queue and specialized kernels.
+   * @param bench_case The case to run.
+   * @param image_file_name Synthetic image of the case.
+   * @param sel_file_name Synthetic SE of the case.
+   * @param options Options of the benchmark.
+   * @returns The timings of the case.
+   */
+  Result RunCase(const Case& bench_case, const std::string& image_file_name,
+                 const std::string& sel_file_name,
+                 const BenchOptions& options) {
+    const std::string kOutputFileName{options.work_dir + "/output.fits"};
+    int data_type;
+    {
+      std::unique_ptr<FitsImage> image{NewFitsImage(image_file_name)};
+      data_type = image->GetDataType();
+    }
+    std::unique_ptr<MorphologyChain> chain;
+    std::unique_ptr<StreamingMorphology> stream;
+    std::unique_ptr<StructuringElement> sel;
+    if (bench_case.engine.mode == EngineMode::STREAMED) {
+      stream.reset(GetStreamingOperation(bench_case.engine.operation, data_type));
+      sel.reset(NewStructuringElement(sel_file_name, data_type));
+      stream->Prepare(sel.get());
+    } else {
+      chain.reset(NewMorphologyChain(
+        bench_case.engine.operation, sel_file_name, data_type,
+        bench_case.engine.mode == EngineMode::HETEROGENEOUS,
+        ThresholdType::NONE));
+    }
+    double total_seconds;
+    for (int run{0}; run < options.warmup; ++run) {
+      RunOnce(bench_case, image_file_name, kOutputFileName, chain.get(),
+              stream.get(), sel.get(), nullptr, total_seconds);
+    }
+    const std::string kKey{bench_case.Key()};
+    std::vector<double> times;
+    std::vector<double> total_times;
+    for (int run{0}; run < options.repetitions; ++run) {
+      times.push_back(RunOnce(bench_case, image_file_name, kOutputFileName,
+                              chain.get(), stream.get(), sel.get(),
+                              kKey.c_str(), total_seconds));
+      total_times.push_back(total_seconds);
+    }
+    Result result;
+    result.bench_case = bench_case;
+    result.median_seconds = Median(times);
+    result.min_seconds = *std::min_element(times.begin(), times.end());
+    result.max_seconds = *std::max_element(times.begin(), times.end());
+    result.spread = result.median_seconds > 0.0 ?
+      (result.max_seconds - result.min_seconds) / result.median_seconds : 0.0;
+    result.pixels_per_second = result.median_seconds > 0.0 ?
+      static_cast<double>(bench_case.size) * bench_case.size /
+      result.median_seconds : 0.0;
+    result.median_total_seconds = Median(total_times);
+    result.counts = Perf::PhaseCounts(kKey);
+    return result;
+  }
+
+  /**
+   * @brief Gives a hardware counter per pixel for the results.
+   * @param counts Counters of the case.
+   * @param counter Counter to divide.
+   * @param divisor Counter to divide by, kCounters to divide by the pixels.
+   * @param scale Factor of the counter, such as the bytes of each event.
+   * @returns The ratio, empty if a counter is not available.
+   */
+  std::string CounterRatio(const Perf::Counts& counts, Perf::Counter counter,
+                           Perf::Counter divisor = Perf::kCounters,
+                           double scale = 1.0) {
+    const bool kPerPixel{divisor == Perf::kCounters};
+    if (!counts.available[counter] || (!kPerPixel && !counts.available[divisor]) ||
+        (kPerPixel ? counts.pixels : counts.values[divisor]) <= 0) {
+      return "";
+    }
+    std::ostringstream ratio;
+    ratio << std::setprecision(6) << scale * counts.values[counter] /
+      (kPerPixel ? counts.pixels : counts.values[divisor]);
+    return ratio.str();
+  }
+
+  // Writes one line per case, with the key fields first.
+  void WriteCsv(const std::string& file_name, const std::vector<Result>& results,
+                int repetitions) {
+    std::ofstream file{file_name};
+    file << kCsvHeader << "\n" << std::setprecision(9);
+    for (const Result& result : results) {
+      file << result.bench_case.Key() << "," << repetitions << ",";
+      if (!result.error.empty()) {
+        // Without measurements, the error is kept in one field
+        std::string error{result.error};
+        std::replace(error.begin(), error.end(), ',', ';');
+        std::replace(error.begin(), error.end(), '\n', ' ');
+        file << ",,,,,,,,,,," << error << "\n";
+        continue;
+      }
+      file << result.median_seconds << "," << result.min_seconds << ","
+           << result.max_seconds << "," << result.spread << ","
+           << result.pixels_per_second << "," << result.median_total_seconds
+           << "," << CounterRatio(result.counts, Perf::CYCLES)
+           << "," << CounterRatio(result.counts, Perf::INSTRUCTIONS)
+           << "," << CounterRatio(result.counts, Perf::INSTRUCTIONS, Perf::CYCLES)
+           << "," << CounterRatio(result.counts, Perf::LLC_MISSES,
+                                  Perf::kCounters, Perf::kCacheLineBytes)
+           << "," << CounterRatio(result.counts, Perf::VECTOR) << ",\n";
+    }
+    if (!file) {
+      throw std::runtime_error("The CSV results could not be written.");
+    }
+  }
+
+  // Writes an array with one object per case.
+  void WriteJson(const std::string& file_name,
+                 const std::vector<Result>& results, int repetitions) {
+    std::ofstream file{file_name};
+    file << "[\n" << std::setprecision(9);
+    for (std::size_t index{0}; index < results.size(); ++index) {
+      const Result& kResult = results[index];
+      const Case& kCase = kResult.bench_case;
+      file << "  {\"engine\": \"" << kCase.engine.name << "\", "
+           << "\"pattern\": \"" << kCase.pattern << "\", "
+           << "\"type\": \"" << kCase.type << "\", "
+           << "\"size\": " << kCase.size << ", "
+           << "\"sel\": \"" << kCase.sel << "\", "
+           << "\"sel_size\": " << kCase.sel_size << ", "
+           << "\"threads\": " << kCase.threads << ", "
+           << "\"repetitions\": " << repetitions << ", ";
+      if (!kResult.error.empty()) {
+        std::string error;
+        for (char character : kResult.error) {
+          if (character == '"' || character == '\\') {
+            error.push_back('\\');
+          }
+          error.push_back(character == '\n' ? ' ' : character);
+        }
+        file << "\"error\": \"" << error << "\"}"
+             << (index + 1 < results.size() ? "," : "") << "\n";
+        continue;
+      }
+      file << "\"median_seconds\": " << kResult.median_seconds << ", "
+           << "\"min_seconds\": " << kResult.min_seconds << ", "
+           << "\"max_seconds\": " << kResult.max_seconds << ", "
+           << "\"spread\": " << kResult.spread << ", "
+           << "\"pixels_per_second\": " << kResult.pixels_per_second << ", "
+           << "\"median_total_seconds\": " << kResult.median_total_seconds;
+      const std::pair<const char*, std::string> kCounterFields[] = {
+        {"cycles_per_pixel", CounterRatio(kResult.counts, Perf::CYCLES)},
+        {"instructions_per_pixel",
+         CounterRatio(kResult.counts, Perf::INSTRUCTIONS)},
+        {"ipc", CounterRatio(kResult.counts, Perf::INSTRUCTIONS, Perf::CYCLES)},
+        {"llc_bytes_per_pixel", CounterRatio(kResult.counts, Perf::LLC_MISSES,
+                                             Perf::kCounters,
+                                             Perf::kCacheLineBytes)},
+        {"vector_per_pixel", CounterRatio(kResult.counts, Perf::VECTOR)}
+      };
+      for (const auto& [name, value] : kCounterFields) {
+        file << ", \"" << name << "\": " << (value.empty() ? "null" : value);
+      }
+      file << "}" << (index + 1 < results.size() ? "," : "") << "\n";
+    }
+    file << "]\n";
+    if (!file) {
+      throw std::runtime_error("The JSON results could not be written.");
+    }
+  }
+
+  /**
+   * @brief Reads the pixels per second of every case of a CSV file written by
+   *  a previous run. Throws an exception if it cannot be read.
+   * @param file_name The CSV file.
+   * @returns The pixels per second by case key.
+   */
+  std::map<std::string, double> ReadBaseline(const std::string& file_name) {
+    std::ifstream file{file_name};
+    std::string line;
+    if (!std::getline(file, line) || line.rfind(kCsvBaselineColumns, 0) != 0) {
+      throw std::invalid_argument("The baseline is not a benchmark CSV file.");
+    }
+    constexpr std::size_t kKeyFields = 7;
+    constexpr std::size_t kPixelsPerSecondField = 12;
+    std::map<std::string, double> baseline;
+    while (std::getline(file, line)) {
+      std::vector<std::string> fields;
+      std::stringstream stream{line};
+      std::string field;
+      while (std::getline(stream, field, ',')) {
+        fields.push_back(field);
+      }
+      // Failed cases have no measurements
+      if (fields.size() <= kPixelsPerSecondField ||
+          fields[kPixelsPerSecondField].empty()) {
+        continue;
+      }
+      std::string key{fields[0]};
+      for (std::size_t index{1}; index < kKeyFields; ++index) {
+        key += "," + fields[index];
+      }
+      baseline[key] = std::stod(fields[kPixelsPerSecondField]);
+    }
+    return baseline;
+  }
+}
+
+/**
+ * @brief Protected main function that can throw exceptions.
+ * @param argc The number of arguments.
+ * @param argv The arguments.
+ * @return The status of the program, 2 if there are regressions, 1 if a case
+ *  failed.
+*/
+int ProtectedMain(int argc, char* argv[]) {
+  EnablePersistentKernelCache();
+  if (argc == 2) {
+    std::string argument{argv[1]};
+    if (argument == "-h" || argument == "--help") {
+      std::cout << kBenchHelp << std::endl;
+      return 0;
+    }
+  }
+  BenchOptions options;
+  if (!ParseBenchArguments(argc, argv, options)) {
+    std::cerr << kBenchHelp << std::endl;
+    return 1;
+  }
+  std::vector<Engine> engines;
+  for (const Engine& engine : AvailableEngines()) {
+    if (options.engines.empty() ||
+        std::count(options.engines.begin(), options.engines.end(),
+                   engine.name) > 0) {
+      engines.push_back(engine);
+    }
+  }
+  if (engines.size() < std::max<std::size_t>(options.engines.size(), 1)) {
+    throw std::invalid_argument("Engine not available in this build.");
+  }
+  std::map<std::string, double> baseline;
+  if (!options.baseline_file_name.empty()) {
+    baseline = ReadBaseline(options.baseline_file_name);
+  }
+  std::filesystem::create_directories(options.work_dir);
+  if (options.perf) {
+    Perf::Enable(options.perf_vector_event);
+  }
+
+  std::vector<Result> results;
+  int regressions{0};
+  int failures{0};
+  std::cout << std::fixed << std::setprecision(3);
+  for (const std::string& size_name : options.sizes) {
+    const long kSize{std::stol(size_name)};
+    for (const std::string& type : options.types) {
+      const int kImageType{GetImageType(type)};
+      for (const std::string& pattern : options.patterns) {
+        const std::string kImageFileName{options.work_dir + "/" + pattern + "_" +
+                                         type + "_" + size_name + ".fits"};
+        if (!std::filesystem::exists(kImageFileName)) {
+          Synthetic::WriteImage(kImageFileName, Synthetic::GetPattern(pattern),
+                                kSize, kImageType);
+        }
+        for (const std::string& sel : options.sels) {
+          for (const std::string& sel_size_name : options.sel_sizes) {
+            const long kSelSize{std::stol(sel_size_name)};
+            const std::string kSelFileName{options.work_dir + "/" + sel + "_" +
+                                           sel_size_name + ".txt"};
+            if (!std::filesystem::exists(kSelFileName)) {
+              Synthetic::WriteSel(kSelFileName, Synthetic::GetSelShape(sel),
+                                  kSelSize);
+            }
+            for (const Engine& engine : engines) {
+              for (const std::string& threads : options.threads) {
+                const Case kCase{engine, pattern, type, kSize, sel, kSelSize,
+                                 std::stoi(threads)};
+                // A case the engine does not support does not stop the rest
+                try {
+                  results.push_back(RunCase(kCase, kImageFileName,
+                                            kSelFileName, options));
+                } catch (const std::exception& error) {
+                  Result failed_result{};
+                  failed_result.bench_case = kCase;
+                  failed_result.error = error.what();
+                  results.push_back(failed_result);
+                  std::cout << kCase.Key() << ": FAILED, " << error.what()
+                            << std::endl;
+                  ++failures;
+                  continue;
+                }
+                const Result& kResult = results.back();
+                std::cout << kCase.Key() << ": "
+                          << kResult.pixels_per_second / 1e6 << " Mpixel/s, "
+                          << "median " << kResult.median_seconds << " (s), "
+                          << "spread " << kResult.spread * 100.0 << "%";
+                auto reference = baseline.find(kCase.Key());
+                if (reference != baseline.end() && reference->second > 0.0) {
+                  const double kRatio{kResult.pixels_per_second /
+                                      reference->second};
+                  std::cout << ", " << kRatio * 100.0 << "% of baseline";
+                  if (kRatio < 1.0 - std::max(options.tolerance, kResult.spread)) {
+                    std::cout << " REGRESSION";
+                    ++regressions;
+                  }
+                }
+                if (options.perf) {
+                  std::cout << ", " << Perf::Metrics(kResult.counts);
+                }
+                std::cout << std::endl;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  WriteCsv(options.csv_file_name, results, options.repetitions);
+  WriteJson(options.json_file_name, results, options.repetitions);
+  if (regressions > 0) {
+    std::cout << regressions << " regression(s) against "
+              << options.baseline_file_name << std::endl;
+    return 2;
+  }
+  if (failures > 0) {
+    std::cout << failures << " case(s) failed" << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  try {
+    return ProtectedMain(argc, argv);
+  } catch (const std::exception& e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+  }
+  return 1;
+}
@@ -0,0 +1,53 @@
+/**
+ * @brief ChainCache class that keeps the chains of operations, with their
+ *  parsed SEs and engines, between jobs.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#include "../include/chain_cache.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include "../include/morphology_chain.h"
+#include "../include/utils.h"
+
+ChainCache::ChainCache(bool heterogeneous, std::size_t capacity):
+    heterogeneous_{heterogeneous},
+    capacity_{std::max<std::size_t>(capacity, 1)} {}
+
+std::shared_ptr<MorphologyChain> ChainCache::Get(
+    const std::string& operations, const std::string& sel_file_names,
+    int data_type, ThresholdType threshold_type) {
+  // Modification times of the SE files, a modified file is parsed again
+  std::vector<std::filesystem::file_time_type> sel_times;
+  std::stringstream sel_names{sel_file_names};
+  std::string sel_name;
+  while (std::getline(sel_names, sel_name, ',')) {
+    std::error_code error;
+    sel_times.push_back(std::filesystem::last_write_time(sel_name, error));
+  }
+  std::ostringstream key;
+  key << operations << '\t' << sel_file_names << '\t' << data_type << '\t'
+      << static_cast<int>(threshold_type);
+  std::lock_guard<std::mutex> lock{mutex_};
+  auto cached = entries_.find(key.str());
+  if (cached != entries_.end() && cached->second.sel_times == sel_times) {
+    cached->second.last_use = ++uses_;
+    return cached->second.chain;
+  }
+  if (cached == entries_.end() && entries_.size() >= capacity_) {
+    entries_.erase(std::min_element(entries_.begin(), entries_.end(),
+      [](const auto& a, const auto& b) {
+        return a.second.last_use < b.second.last_use;
+      }));
+  }
+  std::shared_ptr<MorphologyChain> chain{NewMorphologyChain(
+    operations, sel_file_names, data_type, heterogeneous_, threshold_type)};
+  Entry& entry = entries_[key.str()];
+  entry.chain = chain;
+  entry.sel_times = sel_times;
+  entry.last_use = ++uses_;
+  return chain;
+}
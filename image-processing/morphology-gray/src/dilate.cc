@@ -0,0 +1,49 @@
+/**
+ * @brief Dilate class which implements the morphological dilation operation.
+ *  
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#ifdef USE_SYCL
+  #include "../include/dilate_sycl.h"
+#else
+  #include "../include/dilate.h"
+#endif
+
+Morphology* NewDilate(int data_type) {
+  Morphology* operation;
+  switch (data_type) {
+    case TBYTE: {
+      operation = new Dilate<unsigned char>();
+      break;
+    } case TSBYTE: {
+      operation = new Dilate<signed char>();
+      break;
+    } case TSHORT: {
+      operation = new Dilate<short>();
+      break;
+    } case TUSHORT: {
+      operation = new Dilate<unsigned short>();
+      break;
+    } case TINT: {
+      operation = new Dilate<int>();
+      break;
+    } case TUINT: {
+      operation = new Dilate<unsigned int>();
+      break;
+    } case TLONGLONG: {
+      operation = new Dilate<long long>();
+      break;
+    } case TFLOAT: {
+      operation = new Dilate<float>();
+      break;
+    } case TDOUBLE: {
+      operation = new Dilate<double>();
+      break;
+    } default: {
+      throw std::invalid_argument("Image pixel size unsupported.");
+      break;
+    }
+  }
+  return operation;
+}
@@ -16,11 +16,20 @@ Morphology* NewErode(int data_type) {
     case TBYTE: {
       operation = new Erode<unsigned char>();
       break;
+    } case TSBYTE: {
+      operation = new Erode<signed char>();
+      break;
     } case TSHORT: {
       operation = new Erode<short>();
       break;
-    } case TLONG: {
-      operation = new Erode<long>();
+    } case TUSHORT: {
+      operation = new Erode<unsigned short>();
+      break;
+    } case TINT: {
+      operation = new Erode<int>();
+      break;
+    } case TUINT: {
+      operation = new Erode<unsigned int>();
       break;
     } case TLONGLONG: {
       operation = new Erode<long long>();
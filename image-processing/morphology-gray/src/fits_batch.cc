@@ -0,0 +1,149 @@
+/**
+ * @brief FitsBatch class that processes every plane of a FITS file, the
+ *  planes of the cubes and the images of every extension.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#include "../include/fits_batch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <fitsio.h>
+
+#include "../include/templated_fits_image.h"
+#include "../include/morphology_chain.h"
+
+FitsBatch::FitsBatch(const std::string& file_name): file_name_{file_name} {
+  fitsfile* fits_file;
+  int status{0};
+  fits_open_file(&fits_file, file_name_.c_str(), READONLY, &status);
+  int hdus{0};
+  fits_get_num_hdus(fits_file, &hdus, &status);
+  if (status != 0) {
+    throw std::invalid_argument("The FITS file could not be opened.");
+  }
+  transformed_hdus_.assign(hdus + 1, false);
+  for (int hdu{1}; hdu <= hdus && status == 0; ++hdu) {
+    int hdu_type;
+    fits_movabs_hdu(fits_file, hdu, &hdu_type, &status);
+    if (hdu_type != IMAGE_HDU) {
+      continue;
+    }
+    int axis{0};
+    long dimensions[3] = {0, 0, 1};
+    fits_get_img_dim(fits_file, &axis, &status);
+    if (axis == 0) {
+      continue;
+    }
+    if (axis != 2 && axis != 3) {
+      fits_close_file(fits_file, &status);
+      throw std::invalid_argument("The image is not two or three-dimensional.");
+    }
+    fits_get_img_size(fits_file, axis, dimensions, &status);
+    for (long plane{0}; plane < dimensions[2]; ++plane) {
+      planes_.push_back({hdu, plane});
+    }
+    transformed_hdus_[hdu] = true;
+  }
+  fits_close_file(fits_file, &status);
+  if (status != 0) {
+    throw std::invalid_argument("The HDUs of the FITS file could not be read.");
+  }
+}
+
+void FitsBatch::Apply(const std::function<std::shared_ptr<MorphologyChain>(int)>&
+                        new_chain,
+                      const std::string& output_file_name, int plane_threads,
+                      int io_threads) {
+  // Same HDUs as the input, the image ones get their data later
+  fitsfile* input_file;
+  fitsfile* output_file;
+  int status{0};
+  fits_open_file(&input_file, file_name_.c_str(), READONLY, &status);
+  const std::string kOutputName{"!" + output_file_name};
+  fits_create_file(&output_file, kOutputName.c_str(), &status);
+  for (int hdu{1}; hdu < static_cast<int>(transformed_hdus_.size()); ++hdu) {
+    fits_movabs_hdu(input_file, hdu, nullptr, &status);
+    if (transformed_hdus_[hdu]) {
+      fits_copy_header(input_file, output_file, &status);
+    } else {
+      fits_copy_hdu(input_file, output_file, 0, &status);
+    }
+  }
+  fits_close_file(input_file, &status);
+  if (status != 0) {
+    fits_close_file(output_file, &status);
+    throw std::runtime_error("The output FITS file could not be created.");
+  }
+
+  // Shared by the planes of the same data type
+  std::map<int, std::shared_ptr<MorphologyChain>> chains;
+  std::mutex cache_mutex;
+  std::mutex output_mutex;
+  std::atomic<std::size_t> next_plane{0};
+  std::vector<std::exception_ptr> errors(plane_threads);
+  auto worker = [&](int thread) {
+    try {
+      for (std::size_t index{next_plane++};
+          index < planes_.size();
+          index = next_plane++) {
+        const Plane& kPlane = planes_[index];
+        fitsfile* fits_file;
+        int open_status{0};
+        fits_open_file(&fits_file, file_name_.c_str(), READONLY, &open_status);
+        fits_movabs_hdu(fits_file, kPlane.hdu, nullptr, &open_status);
+        if (open_status != 0) {
+          throw std::runtime_error("The FITS file could not be opened.");
+        }
+        std::unique_ptr<FitsImage> image{OpenFitsImage(fits_file)};
+        image->SelectPlane(kPlane.plane);
+        image->SetIoThreads(io_threads);
+        const int kDataType{image->GetDataType()};
+        MorphologyChain* chain;
+        {
+          std::lock_guard<std::mutex> lock{cache_mutex};
+          if (chains.count(kDataType) == 0) {
+            chains[kDataType] = new_chain(kDataType);
+          }
+          chain = chains[kDataType].get();
+        }
+        image->Load(chain->Padding(), chain->Filling());
+        image->SetMorphology(chain);
+        image->ApplyMorphology(nullptr);
+        std::lock_guard<std::mutex> lock{output_mutex};
+        int write_status{0};
+        fits_movabs_hdu(output_file, kPlane.hdu, nullptr, &write_status);
+        if (write_status != 0) {
+          throw std::runtime_error("The output HDU could not be reached.");
+        }
+        image->WriteToHdu(output_file);
+      }
+    } catch (...) {
+      errors[thread] = std::current_exception();
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int thread{1}; thread < plane_threads; ++thread) {
+    threads.emplace_back(worker, thread);
+  }
+  worker(0);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  fits_close_file(output_file, &status);
+  for (std::exception_ptr& error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+  if (status != 0) {
+    throw std::runtime_error("The output FITS file could not be written.");
+  }
+}
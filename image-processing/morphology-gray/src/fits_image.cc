@@ -7,6 +7,8 @@
 
 #include "../include/fits_image.h"
 
+#include <fcntl.h>
+#include <unistd.h>
 #include <fstream>
 #include <bits/stdc++.h>
 
@@ -17,15 +19,21 @@ FitsImage::FitsImage(fitsfile* fits_file, OpeningMode mode):
   switch (mode) {
     case OpeningMode::OPEN: {
       int real_amount_of_axis{0};
-      fits_get_img_param(fits_file_, kAmountOfAxis, &bitpix_, &real_amount_of_axis,
-        dimensions_, &status_);
-      if (kAmountOfAxis != real_amount_of_axis) {
-        throw std::runtime_error("The image is not two-dimensional.");
+      long dimensions[kAmountOfAxis + 1] = {0, 0, 1};
+      fits_get_img_param(fits_file_, kAmountOfAxis + 1, &bitpix_,
+        &real_amount_of_axis, dimensions, &status_);
+      if (real_amount_of_axis != kAmountOfAxis &&
+          real_amount_of_axis != kAmountOfAxis + 1) {
+        throw std::runtime_error("The image is not two or three-dimensional.");
       }
+      dimensions_[0] = dimensions[0];
+      dimensions_[1] = dimensions[1];
+      planes_ = dimensions[2];
       total_elements_ = dimensions_[0] * dimensions_[1];
       break;
     } case OpeningMode::CREATE: {
     } case OpeningMode::OVERWRITE: {
+      fits_get_img_type(fits_file_, &bitpix_, &status_);
       dimensions_[0] = 0;
       dimensions_[1] = 0;
       total_elements_ = 0;
@@ -34,7 +42,36 @@ FitsImage::FitsImage(fitsfile* fits_file, OpeningMode mode):
       throw std::invalid_argument("Invalid opening mode.");
     }
   }
-  data_type_ = FitsUtils::GetDataType(bitpix_);
+  std::copy_n(dimensions_, kAmountOfAxis, file_dimensions_);
+  std::copy_n(dimensions_, kAmountOfAxis, cutout_dimensions_);
+  if (fits_is_compressed_image(fits_file_, &status_)) {
+    long tile_dimensions[kAmountOfAxis] = {1, 1};
+    fits_get_tile_dim(fits_file_, kAmountOfAxis, tile_dimensions, &status_);
+    tile_columns_ = tile_dimensions[0];
+    tile_rows_ = std::max(tile_dimensions[1], 1L);
+  }
+  int equivalent_bitpix{bitpix_};
+  fits_get_img_equivtype(fits_file_, &equivalent_bitpix, &status_);
+  int key_status{0};
+  fits_read_key(fits_file_, TDOUBLE, "BSCALE", &scale_, nullptr, &key_status);
+  key_status = 0;
+  fits_read_key(fits_file_, TDOUBLE, "BZERO", &zero_, nullptr, &key_status);
+  data_type_ = FitsUtils::GetDataType(bitpix_, equivalent_bitpix, scale_);
+  lazy_scaling_ = (equivalent_bitpix == FLOAT_IMG ||
+                   equivalent_bitpix == DOUBLE_IMG) &&
+                  data_type_ != TFLOAT && data_type_ != TDOUBLE;
+  raw_pixels_ = lazy_scaling_ ||
+                (scale_ == 1.0 && (zero_ == 0.0 ||
+                                   equivalent_bitpix == SBYTE_IMG ||
+                                   equivalent_bitpix == USHORT_IMG ||
+                                   equivalent_bitpix == ULONG_IMG));
+  if (lazy_scaling_) {
+    // The pixels are read and written raw
+    fits_set_bscale(fits_file_, 1.0, 0.0, &status_);
+  } else {
+    scale_ = 1.0;
+    zero_ = 0.0;
+  }
 }
 
 void FitsImage::CopyHeaderFrom(FitsImage& other_image) {
@@ -42,12 +79,222 @@ void FitsImage::CopyHeaderFrom(FitsImage& other_image) {
 }
 
 void FitsImage::WriteToFile(std::string file_name) {
+  Trace::Scope scope{"write", OutputBytes()};
+  if (compression_type_ != 0) {
+    WriteCompressed(file_name);
+    return;
+  }
+  fitsfile* new_file{CreateCopy(file_name)};
+  int status{0};
+  // Writes the header so that the data unit has its final offset
+  fits_flush_file(new_file, &status);
+  LONGLONG header_start, data_start, data_end;
+  fits_get_hduaddrll(new_file, &header_start, &data_start, &data_end, &status);
+  if (status != 0 || !raw_pixels_ || has_region_ ||
+      !FitsUtils::IsPlainFileName(file_name)) {
+    WriteImageData(new_file);
+    fits_close_file(new_file, &status_);
+    return;
+  }
+  fits_close_file(new_file, &status);
+  int file_descriptor{open(file_name.c_str(), O_WRONLY)};
+  if (status != 0 || file_descriptor < 0) {
+    throw std::runtime_error("The output FITS file could not be written.");
+  }
+  // The data unit is padded with zeros up to a whole FITS block
+  const long long kDataBytes{static_cast<long long>(total_elements_) *
+                             (std::abs(bitpix_) / 8)};
+  const long long kFileBytes{data_start +
+                             (kDataBytes + kFitsBlock - 1) / kFitsBlock * kFitsBlock};
+  try {
+    if (ftruncate(file_descriptor, kFileBytes) != 0) {
+      throw std::runtime_error("The output FITS file could not be resized.");
+    }
+    WriteEncodedData(file_descriptor, data_start);
+  } catch (...) {
+    close(file_descriptor);
+    throw;
+  }
+  if (close(file_descriptor) != 0) {
+    throw std::runtime_error("The output FITS file could not be closed.");
+  }
+}
+
+std::future<void> FitsImage::WriteToFileAsync(std::string file_name) {
+  return std::async(std::launch::async, [this, file_name]() {
+    WriteToFile(file_name);
+  });
+}
+
+fitsfile* FitsImage::CreateCopy(std::string file_name) {
   fitsfile* new_file;
+  int status{0};
   // Adds a '!' to the file name to overwrite it.
   file_name = std::string("!") + file_name;
-  fits_create_file(&new_file, file_name.c_str(), &status_);
-  fits_copy_header(fits_file_, new_file, &status_);
-  WriteImageData(new_file);
-  fits_close_file(new_file, &status_);
+  fits_create_file(&new_file, file_name.c_str(), &status);
+  fits_copy_header(fits_file_, new_file, &status);
+  PrepareOutput(new_file, status);
+  if (status != 0) {
+    throw std::runtime_error("The output FITS file could not be created.");
+  }
+  return new_file;
+}
+
+const unsigned char* FitsImage::MapDataUnit(MappedFile& mapping) {
+  int status{0};
+  int compressed{fits_is_compressed_image(fits_file_, &status)};
+  LONGLONG header_start, data_start, data_end;
+  fits_get_hduaddrll(fits_file_, &header_start, &data_start, &data_end, &status);
+  char file_name[FLEN_FILENAME];
+  fits_file_name(fits_file_, file_name, &status);
+  if (status != 0 || compressed || !raw_pixels_) {
+    return nullptr;
+  }
+  try {
+    mapping = MappedFile{file_name};
+  } catch (const std::runtime_error&) {
+    return nullptr;
+  }
+  // CFITSIO also opens gzipped files, which cannot be mapped
+  const std::size_t kPixelBytes = std::abs(bitpix_) / 8;
+  const std::size_t kPlaneStart = data_start + PlaneOffset() * kPixelBytes;
+  const std::size_t kPlaneBytes =
+    file_dimensions_[0] * file_dimensions_[1] * kPixelBytes;
+  if (mapping.Size() < kPlaneStart + kPlaneBytes ||
+      std::memcmp(mapping.Data(), "SIMPLE", 6) != 0) {
+    mapping = MappedFile{};
+    return nullptr;
+  }
+  return mapping.Data() + kPlaneStart;
+}
+
+fitsfile* FitsImage::OpenHandle() {
+  int status{0};
+  char file_name[FLEN_FILENAME];
+  fits_file_name(fits_file_, file_name, &status);
+  int hdu_number;
+  fits_get_hdu_num(fits_file_, &hdu_number);
+  fitsfile* handle;
+  fits_open_file(&handle, file_name, READONLY, &status);
+  fits_movabs_hdu(handle, hdu_number, nullptr, &status);
+  if (lazy_scaling_) {
+    fits_set_bscale(handle, 1.0, 0.0, &status);
+  }
+  if (status != 0) {
+    throw std::runtime_error("The FITS file could not be opened again.");
+  }
+  return handle;
+}
+
+void FitsImage::WriteCompressed(const std::string& file_name) {
+  int status{0};
+  fitsfile* memory_file;
+  fits_create_file(&memory_file, "mem://", &status);
+  fits_copy_header(fits_file_, memory_file, &status);
+  PrepareOutput(memory_file, status);
+  if (status != 0) {
+    fits_close_file(memory_file, &status);
+    throw std::runtime_error("The output FITS image could not be created.");
+  }
+  WriteImageData(memory_file);
+  fitsfile* new_file;
+  const std::string kFileName{std::string("!") + file_name};
+  fits_create_file(&new_file, kFileName.c_str(), &status);
+  // Keeps the tiles of the input, whole rows otherwise
+  long tile_dimensions[kAmountOfAxis] = {
+    tile_columns_ > 0 && !has_region_ ? tile_columns_ : cutout_dimensions_[0],
+    has_region_ ? 1 : tile_rows_};
+  // Floating point pixels are not quantized, CFITSIO only compresses them
+  // losslessly with GZIP
+  int compression_type{compression_type_};
+  if (bitpix_ < 0 && compression_type != GZIP_1) {
+    compression_type = GZIP_2;
+  }
+  // HCOMPRESS needs tiles of 4 rows at least, the last one included
+  if (compression_type == HCOMPRESS_1) {
+    long& tile_rows = tile_dimensions[1];
+    if (tile_rows < kHcompressMinimumRows) {
+      tile_rows = std::min(kHcompressTileRows, cutout_dimensions_[1]);
+    }
+    while (cutout_dimensions_[1] % tile_rows != 0 &&
+           cutout_dimensions_[1] % tile_rows < kHcompressMinimumRows) {
+      ++tile_rows;
+    }
+  }
+  fits_set_compression_type(new_file, compression_type, &status);
+  fits_set_tile_dim(new_file, kAmountOfAxis, tile_dimensions, &status);
+  fits_set_quantize_level(new_file, 0.0f, &status);
+  fits_img_compress(memory_file, new_file, &status);
+  fits_close_file(new_file, &status);
+  int memory_status{0};
+  fits_close_file(memory_file, &memory_status);
+  if (status != 0) {
+    throw std::runtime_error("The compressed output FITS file could not be written.");
+  }
+}
+
+void FitsImage::SelectPlane(long plane) {
+  if (plane < 0 || plane >= planes_) {
+    throw std::out_of_range("The image has no such plane.");
+  }
+  plane_ = plane;
 }
 
+void FitsImage::SetRegion(long first_column, long first_row, long columns,
+                          long rows, long halo) {
+  const long kFirst[kAmountOfAxis] = {first_column, first_row};
+  const long kAmount[kAmountOfAxis] = {columns, rows};
+  for (int axis{0}; axis < kAmountOfAxis; ++axis) {
+    const long kStart{std::max(kFirst[axis], 0L)};
+    const long kEnd{std::min(kFirst[axis] + kAmount[axis], file_dimensions_[axis])};
+    if (kEnd <= kStart) {
+      throw std::out_of_range("The region is outside of the image.");
+    }
+    region_start_[axis] = std::max(kStart - halo, 0L);
+    dimensions_[axis] = std::min(kEnd + halo, file_dimensions_[axis]) -
+                        region_start_[axis];
+    cutout_start_[axis] = kStart - region_start_[axis];
+    cutout_dimensions_[axis] = kEnd - kStart;
+  }
+  total_elements_ = dimensions_[0] * dimensions_[1];
+  has_region_ = true;
+}
+
+void FitsImage::WriteToHdu(fitsfile* fits_file) {
+  Trace::Scope scope{"write", OutputBytes()};
+  int status{0};
+  PrepareOutput(fits_file, status);
+  if (status != 0) {
+    throw std::runtime_error("The output HDU could not be prepared.");
+  }
+  WriteImageData(fits_file);
+}
+
+void FitsImage::PrepareOutput(fitsfile* fits_file, int& status) {
+  if (lazy_scaling_) {
+    // Raw pixels, the keywords describe how to scale them
+    fits_update_key(fits_file, TDOUBLE, "BSCALE", &scale_, nullptr, &status);
+    fits_update_key(fits_file, TDOUBLE, "BZERO", &zero_, nullptr, &status);
+    fits_set_bscale(fits_file, 1.0, 0.0, &status);
+  }
+  if (has_region_) {
+    int axis{0};
+    fits_get_img_dim(fits_file, &axis, &status);
+    long dimensions[kAmountOfAxis + 1] = {cutout_dimensions_[0],
+                                          cutout_dimensions_[1], 1};
+    fits_resize_img(fits_file, bitpix_, axis, dimensions, &status);
+    // The WCS reference pixel moves with the origin of the cutout
+    const char* kReferenceKeys[kAmountOfAxis] = {"CRPIX1", "CRPIX2"};
+    for (int index{0}; index < kAmountOfAxis; ++index) {
+      double reference;
+      int key_status{0};
+      fits_read_key(fits_file, TDOUBLE, kReferenceKeys[index], &reference,
+                    nullptr, &key_status);
+      if (key_status == 0) {
+        reference -= region_start_[index] + cutout_start_[index];
+        fits_update_key(fits_file, TDOUBLE, kReferenceKeys[index], &reference,
+                        nullptr, &status);
+      }
+    }
+  }
+}
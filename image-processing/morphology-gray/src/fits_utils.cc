@@ -8,6 +8,7 @@
 
 #include <fitsio.h>
 #include <fstream>
+#include <stdexcept>
 #include <string>
 
 bool FitsUtils::FileExists(const std::string& file_name) {
@@ -17,16 +18,52 @@ bool FitsUtils::FileExists(const std::string& file_name) {
   return exists;
 }
 
-int FitsUtils::GetDataType(int bitpix) {
-  switch (bitpix) {
+bool FitsUtils::IsPlainFileName(const std::string& file_name) {
+  auto ends_with = [&](const std::string& suffix) {
+    return file_name.size() >= suffix.size() &&
+           file_name.compare(file_name.size() - suffix.size(), suffix.size(),
+                             suffix) == 0;
+  };
+  return file_name.find('[') == std::string::npos &&
+         file_name.find("://") == std::string::npos &&
+         file_name.rfind("mem:", 0) != 0 &&
+         file_name.rfind("-", 0) != 0 &&
+         !ends_with(".gz") && !ends_with(".Z");
+}
+
+std::unique_lock<std::mutex> FitsUtils::LockUnlessReentrant(
+    std::mutex& mutex) {
+  if (fits_is_reentrant()) {
+    return std::unique_lock<std::mutex>{mutex, std::defer_lock};
+  }
+  return std::unique_lock<std::mutex>{mutex};
+}
+
+int FitsUtils::GetDataType(int bitpix, int equivalent_bitpix, double scale) {
+  const bool kFloatingPoint{equivalent_bitpix == FLOAT_IMG ||
+                            equivalent_bitpix == DOUBLE_IMG};
+  if (bitpix > 0 && kFloatingPoint && scale > 0.0) {
+    // Raw integers, scaled lazily
+    equivalent_bitpix = bitpix;
+  }
+  switch (equivalent_bitpix) {
     case BYTE_IMG: {
       return TBYTE;
       break;
+    } case SBYTE_IMG: {
+      return TSBYTE;
+      break;
     } case SHORT_IMG: {
       return TSHORT;
       break;
+    } case USHORT_IMG: {
+      return TUSHORT;
+      break;
     } case LONG_IMG: {
-      return TLONG;
+      return TINT;
+      break;
+    } case ULONG_IMG: {
+      return TUINT;
       break;
     } case LONGLONG_IMG: {
       return TLONGLONG;
@@ -42,4 +79,4 @@ int FitsUtils::GetDataType(int bitpix) {
       break;
     }
   }
-}
\ No newline at end of file
+}
@@ -0,0 +1,46 @@
+/**
+ * @brief HeterogeneousErode class which splits a morphological erosion among
+ *  every SYCL device and the host CPU.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#include "../include/heterogeneous_erode_sycl.h"
+
+Morphology* NewHeterogeneousErode(int data_type) {
+  Morphology* operation;
+  switch (data_type) {
+    case TBYTE: {
+      operation = new HeterogeneousErode<unsigned char>();
+      break;
+    } case TSBYTE: {
+      operation = new HeterogeneousErode<signed char>();
+      break;
+    } case TSHORT: {
+      operation = new HeterogeneousErode<short>();
+      break;
+    } case TUSHORT: {
+      operation = new HeterogeneousErode<unsigned short>();
+      break;
+    } case TINT: {
+      operation = new HeterogeneousErode<int>();
+      break;
+    } case TUINT: {
+      operation = new HeterogeneousErode<unsigned int>();
+      break;
+    } case TLONGLONG: {
+      operation = new HeterogeneousErode<long long>();
+      break;
+    } case TFLOAT: {
+      operation = new HeterogeneousErode<float>();
+      break;
+    } case TDOUBLE: {
+      operation = new HeterogeneousErode<double>();
+      break;
+    } default: {
+      throw std::invalid_argument("Image pixel size unsupported.");
+      break;
+    }
+  }
+  return operation;
+}
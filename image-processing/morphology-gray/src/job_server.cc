@@ -0,0 +1,236 @@
+/**
+ * @brief JobServer class that transforms FITS files requested through a Unix
+ *  domain socket, keeping the engines warm between jobs.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#include "../include/job_server.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "../include/fits_batch.h"
+#include "../include/fits_utils.h"
+#include "../include/morphology_chain.h"
+#include "../include/templated_fits_image.h"
+
+JobServer::JobServer(const std::string& socket_path, const Options& options,
+                     int workers, std::size_t queue_capacity):
+    socket_path_{socket_path}, options_{options},
+    // The heterogeneous split already uses every device for each job, and
+    // keeps the throughputs of the devices for the next one
+    workers_{options.heterogeneous ? 1 : std::max(workers, 1)},
+    queue_{queue_capacity},
+    chains_{options.heterogeneous} {}
+
+JobServer::~JobServer() {
+  if (listener_ >= 0) {
+    close(listener_);
+    unlink(socket_path_.c_str());
+  }
+}
+
+void JobServer::Run() {
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socket_path_.size() >= sizeof(address.sun_path)) {
+    throw std::invalid_argument("The socket path is too long.");
+  }
+  std::strcpy(address.sun_path, socket_path_.c_str());
+  listener_ = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener_ < 0) {
+    throw std::runtime_error("The socket could not be created.");
+  }
+  unlink(socket_path_.c_str());
+  if (bind(listener_, reinterpret_cast<sockaddr*>(&address),
+           sizeof(address)) != 0 ||
+      listen(listener_, SOMAXCONN) != 0) {
+    throw std::runtime_error("The socket could not be bound to " +
+                             socket_path_ + ".");
+  }
+
+  std::vector<std::thread> workers;
+  for (int worker{0}; worker < workers_; ++worker) {
+    workers.emplace_back(&JobServer::Work, this);
+  }
+  while (true) {
+    const int kConnection{accept(listener_, nullptr, nullptr)};
+    if (kConnection < 0) {
+      if (stopping_) {
+        break;
+      }
+      continue;
+    }
+    {
+      std::lock_guard<std::mutex> lock{connections_mutex_};
+      connections_.insert(kConnection);
+    }
+    // Removes itself from connections_ when done, nothing to join
+    std::thread{&JobServer::Serve, this, kConnection}.detach();
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  // Idle clients would keep their connections open
+  std::unique_lock<std::mutex> lock{connections_mutex_};
+  for (int connection : connections_) {
+    shutdown(connection, SHUT_RDWR);
+  }
+  connections_closed_.wait(lock, [this]() { return connections_.empty(); });
+}
+
+void JobServer::Serve(int connection) {
+  std::string buffer;
+  char chunk[4096];
+  bool open{true};
+  while (open) {
+    const ssize_t kRead{read(connection, chunk, sizeof(chunk))};
+    if (kRead <= 0) {
+      break;
+    }
+    buffer.append(chunk, kRead);
+    for (std::size_t end{buffer.find('\n')};
+        end != std::string::npos && open;
+        end = buffer.find('\n')) {
+      std::string line{buffer.substr(0, end)};
+      buffer.erase(0, end + 1);
+      if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+      }
+      if (line.empty()) {
+        continue;
+      }
+      std::string response;
+      if (line == "shutdown") {
+        Stop();
+        response = "OK shutting down";
+        open = false;
+      } else {
+        std::vector<std::string> fields;
+        std::stringstream stream{line};
+        std::string field;
+        while (std::getline(stream, field, '\t')) {
+          fields.push_back(field);
+        }
+        auto job = std::make_shared<Job>();
+        std::future<std::string> result{job->response.get_future()};
+        try {
+          if (fields.size() != 4 && fields.size() != 5) {
+            throw std::invalid_argument("A job needs 4 or 5 tab-separated "
+                                        "fields.");
+          }
+          job->image_file_name = fields[0];
+          job->sel_file_name = fields[1];
+          job->output_file_name = fields[2];
+          job->operation = fields[3];
+          if (fields.size() == 5) {
+            job->threshold_type = GetThresholdType(fields[4]);
+          }
+          if (queue_.Push(job)) {
+            response = result.get();
+          } else {
+            response = "ERROR The server is shutting down.";
+          }
+        } catch (const std::exception& error) {
+          response = std::string{"ERROR "} + error.what();
+        }
+      }
+      response.push_back('\n');
+      // The client may be gone, which must not raise SIGPIPE
+      send(connection, response.data(), response.size(), MSG_NOSIGNAL);
+    }
+  }
+  // Closed before it is erased, so accept() cannot reuse it while listed
+  std::lock_guard<std::mutex> lock{connections_mutex_};
+  close(connection);
+  connections_.erase(connection);
+  connections_closed_.notify_all();
+}
+
+void JobServer::Work() {
+  std::shared_ptr<Job> job;
+  while (queue_.Pop(job)) {
+    std::string response;
+    try {
+      response = RunJob(*job);
+    } catch (const std::exception& error) {
+      response = std::string{"ERROR "} + error.what();
+    }
+    job->response.set_value(response);
+  }
+}
+
+std::string JobServer::RunJob(Job& job) {
+  auto start_time = std::chrono::steady_clock::now();
+  std::unique_ptr<FitsBatch> batch;
+  {
+    std::unique_lock<std::mutex> lock{
+      FitsUtils::LockUnlessReentrant(fits_mutex_)};
+    batch = std::make_unique<FitsBatch>(job.image_file_name);
+  }
+  if (batch->Planes() > 1) {
+    if (options_.compression_type != 0) {
+      throw std::invalid_argument("Cubes and multi-extension files cannot be "
+                                  "written compressed.");
+    }
+    auto new_chain = [&](int data_type) {
+      return chains_.Get(job.operation, job.sel_file_name, data_type,
+                         job.threshold_type);
+    };
+    // The whole file is read, transformed and written here
+    std::unique_lock<std::mutex> lock{
+      FitsUtils::LockUnlessReentrant(fits_mutex_)};
+    batch->Apply(new_chain, job.output_file_name, 1, options_.io_threads);
+  } else {
+    std::shared_ptr<MorphologyChain> chain;
+    std::unique_ptr<FitsImage> image;
+    try {
+      {
+        std::unique_lock<std::mutex> lock{
+          FitsUtils::LockUnlessReentrant(fits_mutex_)};
+        image.reset(NewFitsImage(job.image_file_name));
+        image->SetIoThreads(options_.io_threads);
+        image->SetCompression(options_.compression_type);
+        chain = chains_.Get(job.operation, job.sel_file_name,
+                            image->GetDataType(), job.threshold_type);
+        image->Load(chain->Padding(), chain->Filling());
+      }
+      image->SetMorphology(chain.get());
+      image->ApplyMorphology(nullptr);
+      std::unique_lock<std::mutex> lock{
+        FitsUtils::LockUnlessReentrant(fits_mutex_)};
+      image->WriteToFile(job.output_file_name);
+      image.reset();
+    } catch (...) {
+      // Closing the file calls CFITSIO as well
+      std::unique_lock<std::mutex> lock{
+        FitsUtils::LockUnlessReentrant(fits_mutex_)};
+      image.reset();
+      throw;
+    }
+  }
+  auto end_time = std::chrono::steady_clock::now();
+  std::ostringstream response;
+  response << "OK " << NanosecondsToSeconds(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      end_time - start_time).count());
+  return response.str();
+}
+
+void JobServer::Stop() {
+  stopping_ = true;
+  queue_.Close();
+  // Wakes the accept of Run()
+  shutdown(listener_, SHUT_RDWR);
+}
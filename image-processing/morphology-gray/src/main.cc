@@ -9,9 +9,18 @@
 #include <iostream>
 #include <chrono>
 #include <algorithm>
+#include <future>
+#include <thread>
 
 #include "../include/templated_fits_image.h"
 #include "../include/templated_structuring_element.h"
+#include "../include/streaming_morphology.h"
+#include "../include/batch_scheduler.h"
+#include "../include/fits_batch.h"
+#include "../include/job_server.h"
+#include "../include/morphology_chain.h"
+#include "../include/perf_counters.h"
+#include "../include/trace.h"
 #include "../include/utils.h"
 
 /**
@@ -21,42 +30,188 @@
  * @return The status of the program.
 */
 int ProtectedMain(int argc, char* argv[]) {
+  EnablePersistentKernelCache();
   if (argc == 2) {
     std::string argument{argv[1]};
     if (argument == "-h" || argument == "--help") {
       std::cout << Text::kHelp << std::endl;
       return 0;
-    } else {
-      std::cerr << Text::kUsage << std::endl;
-      return 1;
     }
-  } else if (argc != 5) {
+  }
+  Options options;
+  if (!ParseArguments(argc, argv, options)) {
     std::cerr << Text::kUsage << std::endl;
     return 1;
   }
   
-  std::string image_file_name{argv[1]};
-  std::string sel_file_name{argv[2]};
-  std::string output_file_name{argv[3]};
-  std::string operation_input{argv[4]};
+  std::string image_file_name{options.image_file_name};
+  std::string sel_file_name{options.sel_file_name};
+  std::string output_file_name{options.output_file_name};
+  std::string operation_input{options.operation};
+  // Before any engine is created, so their queues get profiling
+  if (!options.trace_file_name.empty()) {
+    Trace::Enable();
+  }
+  if (options.perf) {
+    Perf::Enable(options.perf_vector_event);
+  }
+  if (options.pool_memory > 0) {
+    SetDevicePoolLimit(options.pool_memory);
+  }
+  if (!options.serve_socket.empty()) {
+    if (options.roi.columns > 0 || options.strip_rows > 0 ||
+        options.max_memory > 0) {
+      throw std::invalid_argument("The server does not support regions or "
+                                  "streaming.");
+    }
+    JobServer server{options.serve_socket, options, options.serve_workers,
+                     static_cast<std::size_t>(options.serve_queue)};
+    std::cout << "Serving jobs on " << options.serve_socket << std::endl;
+    server.Run();
+    if (Trace::Enabled()) {
+      Trace::Write(options.trace_file_name);
+      std::cout << Trace::Summary();
+    }
+    if (Perf::Enabled()) {
+      std::cout << Perf::Summary();
+    }
+    return 0;
+  }
+  if (!options.batch_file_name.empty()) {
+    if (options.roi.columns > 0 || options.strip_rows > 0 ||
+        options.max_memory > 0) {
+      throw std::invalid_argument("Batches do not support regions or "
+                                  "streaming.");
+    }
+    int compute_threads{options.batch_compute_threads};
+    if (compute_threads == 0) {
+      compute_threads = std::max(
+        static_cast<int>(std::thread::hardware_concurrency()), 1);
+    }
+    // The heterogeneous split already uses every device for each image
+    if (options.heterogeneous) {
+      compute_threads = 1;
+    }
+    BatchScheduler scheduler{options, options.batch_load_threads,
+                             compute_threads, options.batch_write_threads,
+                             static_cast<std::size_t>(options.batch_queue)};
+    const long kFailed{scheduler.Run(options.batch_file_name, std::cout)};
+    if (Trace::Enabled()) {
+      Trace::Write(options.trace_file_name);
+      std::cout << Trace::Summary();
+    }
+    if (Perf::Enabled()) {
+      std::cout << Perf::Summary();
+    }
+    return kFailed == 0 ? 0 : 1;
+  }
 
   auto start_program_time = std::chrono::steady_clock::now();
   
-  FitsImage* image = NewFitsImage(image_file_name);
-  const int kDataType{image->GetDataType()};
-  StructuringElement* sel = NewStructuringElement(sel_file_name, kDataType);
-  Morphology* operation = GetMorphologyOperation(operation_input, kDataType);
-  const long kPadding{std::max(sel->Rows(), sel->Columns())};
-  image->Load(kPadding, GetFillingType(operation_input));
-  image->SetMorphology(operation);
-  auto start_operation_time = std::chrono::steady_clock::now();
-  image->ApplyMorphology(sel);
-  auto end_operation_time = std::chrono::steady_clock::now();
-  image->WriteToFile(output_file_name);
+  std::chrono::steady_clock::time_point start_operation_time;
+  std::chrono::steady_clock::time_point end_operation_time;
+  const bool kRegion{options.roi.columns > 0};
+  if (kRegion && !IsLocalOperation(operation_input)) {
+    throw std::invalid_argument("The operation is not local, it cannot be "
+                                "restricted to a region.");
+  }
+  FitsBatch batch{image_file_name};
+  if (batch.Planes() > 1) {
+    if (kRegion) {
+      throw std::invalid_argument("Regions of cubes and multi-extension files "
+                                  "are not supported.");
+    }
+    if (options.strip_rows > 0 || options.max_memory > 0) {
+      throw std::invalid_argument("Cubes and multi-extension files cannot be "
+                                  "streamed.");
+    }
+    if (options.compression_type != 0) {
+      throw std::invalid_argument("Cubes and multi-extension files cannot be "
+                                  "written compressed.");
+    }
+    int plane_threads{options.plane_threads};
+    if (plane_threads == 0) {
+      plane_threads = std::max(
+        static_cast<int>(std::thread::hardware_concurrency()), 1);
+    }
+    // The heterogeneous split already uses every device for each plane
+    if (options.heterogeneous || !fits_is_reentrant()) {
+      plane_threads = 1;
+    }
+    plane_threads = static_cast<int>(std::min<long>(plane_threads,
+                                                    batch.Planes()));
+    auto new_chain = [&](int data_type) {
+      return std::shared_ptr<MorphologyChain>{NewMorphologyChain(
+        operation_input, sel_file_name, data_type, options.heterogeneous,
+        options.threshold_type)};
+    };
+    start_operation_time = std::chrono::steady_clock::now();
+    batch.Apply(new_chain, output_file_name, plane_threads, options.io_threads);
+    end_operation_time = std::chrono::steady_clock::now();
+  } else {
+    FitsImage* image = NewFitsImage(image_file_name);
+    image->SetIoThreads(options.io_threads);
+    image->SetCompression(options.compression_type);
+    const int kDataType{image->GetDataType()};
+    if (options.strip_rows > 0 || options.max_memory > 0) {
+      if (operation_input.size() > 1) {
+        throw std::invalid_argument("Chains of operations cannot be streamed.");
+      }
+      if (kRegion) {
+        throw std::invalid_argument("A region is loaded whole, it cannot be "
+                                    "streamed.");
+      }
+      if (options.threshold_type != ThresholdType::NONE) {
+        throw std::invalid_argument("Thresholds need the whole image, "
+                                    "they cannot be used when streaming.");
+      }
+      if (options.compression_type != 0) {
+        throw std::invalid_argument("Compressed outputs cannot be streamed.");
+      }
+      StreamingMorphology* operation =
+        GetStreamingOperation(operation_input, kDataType);
+      StructuringElement* sel = NewStructuringElement(sel_file_name, kDataType);
+      operation->Prepare(sel);
+      long strip_rows{options.strip_rows};
+      if (options.max_memory > 0) {
+        const long kBudgetRows{operation->StripRows(image, sel, options.max_memory)};
+        strip_rows = strip_rows > 0 ? std::min(strip_rows, kBudgetRows) : kBudgetRows;
+      }
+      strip_rows = std::max(std::min(strip_rows, image->Rows()), 1L);
+      // Whole rows of tiles, so no tile is decompressed twice
+      if (strip_rows > image->TileRows()) {
+        strip_rows = strip_rows / image->TileRows() * image->TileRows();
+      }
+      start_operation_time = std::chrono::steady_clock::now();
+      {
+        Perf::Scope perf_scope{"stream erode", static_cast<double>(
+          image->Rows()) * image->Columns()};
+        operation->Stream(image, sel, output_file_name, strip_rows);
+      }
+      end_operation_time = std::chrono::steady_clock::now();
+      delete operation;
+      delete sel;
+    } else {
+      MorphologyChain* operation = NewMorphologyChain(
+        operation_input, sel_file_name, kDataType, options.heterogeneous,
+        options.threshold_type);
+      if (kRegion) {
+        image->SetRegion(options.roi.first_column, options.roi.first_row,
+                         options.roi.columns, options.roi.rows,
+                         operation->Halo());
+      }
+      image->Load(operation->Padding(), operation->Filling());
+      image->SetMorphology(operation);
+      start_operation_time = std::chrono::steady_clock::now();
+      image->ApplyMorphology(nullptr);
+      end_operation_time = std::chrono::steady_clock::now();
+      std::future<void> written{image->WriteToFileAsync(output_file_name)};
+      delete operation;
+      written.get();
+    }
 
-  delete image;
-  delete sel;
-  delete operation;
+    delete image;
+  }
 
   auto end_program_time = std::chrono::steady_clock::now();
 
@@ -68,6 +223,13 @@ int ProtectedMain(int argc, char* argv[]) {
             << NanosecondsToSeconds(program_time) << " (s)" << std::endl;
   std::cout << "Operation execution time: "
             << NanosecondsToSeconds(operation_time) << " (s)" << std::endl;
+  if (Trace::Enabled()) {
+    Trace::Write(options.trace_file_name);
+    std::cout << Trace::Summary();
+  }
+  if (Perf::Enabled()) {
+    std::cout << Perf::Summary();
+  }
 
   return 0;
 }
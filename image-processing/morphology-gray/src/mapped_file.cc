@@ -0,0 +1,60 @@
+/**
+ * @brief Mapped File class that maps a whole file into memory.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#include "../include/mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <utility>
+
+MappedFile::MappedFile(const std::string& file_name):
+    data_{nullptr}, size_{0} {
+  int file_descriptor{open(file_name.c_str(), O_RDONLY)};
+  if (file_descriptor < 0) {
+    throw std::runtime_error("The file could not be opened for mapping.");
+  }
+  struct stat file_status;
+  if (fstat(file_descriptor, &file_status) != 0 ||
+      !S_ISREG(file_status.st_mode) || file_status.st_size == 0) {
+    close(file_descriptor);
+    throw std::runtime_error("The file cannot be mapped.");
+  }
+  size_ = file_status.st_size;
+  void* data{mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                  file_descriptor, 0)};
+  // The mapping keeps its own reference to the file
+  close(file_descriptor);
+  if (data == MAP_FAILED) {
+    size_ = 0;
+    throw std::runtime_error("The file could not be mapped.");
+  }
+  madvise(data, size_, MADV_SEQUENTIAL);
+  data_ = static_cast<unsigned char*>(data);
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept:
+    data_{std::exchange(other.data_, nullptr)},
+    size_{std::exchange(other.size_, 0)} {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+  if (this != &other) {
+    Unmap();
+    data_ = std::exchange(other.data_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+  }
+  return *this;
+}
+
+void MappedFile::Unmap() {
+  if (data_ != nullptr) {
+    munmap(data_, size_);
+    data_ = nullptr;
+    size_ = 0;
+  }
+}
@@ -0,0 +1,147 @@
+/**
+ * @brief Public interface of libmorph, the morphological operations on images
+ *  already in memory, without CFITSIO nor file I/O.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#include "../include/morph.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#include "../include/templated_structuring_element.h"
+#include "../include/erode_region.h"
+
+namespace {
+
+/**
+ * @brief Erodes a pixel whose SE neighbourhood leaves the image, only the
+ *  neighbours inside of it are used.
+ * @param source Image to erode.
+ * @param source_stride Distance, in pixels, between two rows of the source.
+ * @param rows Amount of rows of the image.
+ * @param columns Amount of columns of the image.
+ * @param row Row of the pixel.
+ * @param column Column of the pixel.
+ * @param sel Structuring element for the operation.
+ * @returns The eroded pixel.
+ */
+template<typename T>
+T ErodeBorderPixel(const T* source, long source_stride, long rows, long columns,
+                   long row, long column, TemplatedStructuringElement<T>& sel) {
+  const T* sel_data = sel.GetData();
+  T minimum = std::numeric_limits<T>::max();
+  for (long local_row{0}; local_row < sel.Rows(); ++local_row) {
+    const long kRow{row + local_row - sel.CenterRow()};
+    if (kRow < 0 || kRow >= rows) {
+      continue;
+    }
+    for (long local_column{0}; local_column < sel.Columns(); ++local_column) {
+      const long kColumn{column + local_column - sel.CenterColumn()};
+      if (kColumn < 0 || kColumn >= columns ||
+          sel_data[local_row * sel.Columns() + local_column] != 1) {
+        continue;
+      }
+      minimum = std::min(minimum, source[kRow * source_stride + kColumn]);
+    }
+  }
+  return minimum;
+}
+
+/**
+ * @brief Erodes a strided image in place of the caller, the pixels whose SE
+ *  neighbourhood fits in the image with the engine of the padded images and
+ *  the border ones checking every neighbour.
+ * @param source Image to erode.
+ * @param destination Where the eroded image is stored.
+ * @param descriptor Structuring element for the operation.
+ */
+template<typename T>
+void ErodeView(const Morph::ImageView& source,
+               const Morph::ImageView& destination,
+               const Morph::SelDescriptor& descriptor) {
+  TemplatedStructuringElement<T> sel{descriptor.mask, descriptor.rows,
+                                     descriptor.columns, descriptor.center_row,
+                                     descriptor.center_column};
+  const T* source_data = static_cast<const T*>(source.data);
+  T* destination_data = static_cast<T*>(destination.data);
+  const long kRows{source.rows};
+  const long kColumns{source.columns};
+  // Pixels whose whole neighbourhood is inside of the image
+  const long kTop{std::min(sel.CenterRow(), kRows)};
+  const long kBottom{std::max(kRows - (sel.Rows() - 1 - sel.CenterRow()), kTop)};
+  const long kLeft{std::min(sel.CenterColumn(), kColumns)};
+  const long kRight{std::max(kColumns - (sel.Columns() - 1 - sel.CenterColumn()),
+                             kLeft)};
+  if (kBottom > kTop && kRight > kLeft) {
+    ErodeRegion(source_data + kTop * source.row_stride + kLeft, source.row_stride,
+                destination_data + kTop * destination.row_stride + kLeft,
+                destination.row_stride, kBottom - kTop, kRight - kLeft, sel);
+  }
+  for (long row{0}; row < kRows; ++row) {
+    T* destination_row{destination_data + row * destination.row_stride};
+    const bool kInnerRow{row >= kTop && row < kBottom};
+    for (long column{0}; column < kColumns; ++column) {
+      if (kInnerRow && column == kLeft) {
+        column = kRight;
+        if (column >= kColumns) {
+          break;
+        }
+      }
+      destination_row[column] = ErodeBorderPixel(source_data, source.row_stride,
+                                                 kRows, kColumns, row, column,
+                                                 sel);
+    }
+  }
+}
+
+} // namespace
+
+void Morph::Erode(const ImageView& source, const ImageView& destination,
+                  const SelDescriptor& sel) {
+  if (source.data == nullptr || destination.data == nullptr ||
+      source.rows <= 0 || source.columns <= 0 ||
+      source.row_stride < source.columns ||
+      destination.row_stride < destination.columns) {
+    throw std::invalid_argument("Invalid image.");
+  }
+  if (source.rows != destination.rows || source.columns != destination.columns ||
+      source.type != destination.type) {
+    throw std::invalid_argument("The images must have the same shape and type.");
+  }
+  switch (source.type) {
+    case PixelType::UINT8: {
+      ErodeView<unsigned char>(source, destination, sel);
+      break;
+    } case PixelType::INT8: {
+      ErodeView<signed char>(source, destination, sel);
+      break;
+    } case PixelType::INT16: {
+      ErodeView<short>(source, destination, sel);
+      break;
+    } case PixelType::UINT16: {
+      ErodeView<unsigned short>(source, destination, sel);
+      break;
+    } case PixelType::INT32: {
+      ErodeView<int>(source, destination, sel);
+      break;
+    } case PixelType::UINT32: {
+      ErodeView<unsigned int>(source, destination, sel);
+      break;
+    } case PixelType::INT64: {
+      ErodeView<long long>(source, destination, sel);
+      break;
+    } case PixelType::FLOAT32: {
+      ErodeView<float>(source, destination, sel);
+      break;
+    } case PixelType::FLOAT64: {
+      ErodeView<double>(source, destination, sel);
+      break;
+    } default: {
+      throw std::invalid_argument("Image pixel type unsupported.");
+      break;
+    }
+  }
+}
@@ -6,5 +6,21 @@
 
 #include "../include/morphology.h"
 
+#include "../include/fits_image.h"
+
 Morphology::~Morphology() {}
 
+void Morphology::ApplyThreshold(FitsImage* fits_image) {
+  switch (threshold_type_) {
+    case ThresholdType::NONE: {
+      break;
+    } case ThresholdType::MEDIAN: {
+      fits_image->Binarize(fits_image->CalculateMedian());
+      break;
+    } case ThresholdType::MEAN: {
+      fits_image->Binarize(fits_image->CalculateMean());
+      break;
+    }
+  }
+}
+
@@ -0,0 +1,61 @@
+/**
+ * @brief MorphologyChain class that applies several morphology operations one
+ *  after another, each with its own structuring element.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#include "../include/morphology_chain.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "../include/fits_image.h"
+#include "../include/perf_counters.h"
+#include "../include/trace.h"
+
+void MorphologyChain::AddStep(Morphology* operation, StructuringElement* sel,
+                              PaddingType filling, const std::string& name) {
+  steps_.push_back({std::unique_ptr<Morphology>{operation},
+                    std::unique_ptr<StructuringElement>{sel}, filling, name});
+  operation->Prepare(sel);
+}
+
+void MorphologyChain::Operate(FitsImage* fits_image,
+                              StructuringElement* operation_sel) {
+  const double kPixels{static_cast<double>(fits_image->Rows()) *
+                       fits_image->Columns()};
+  for (std::size_t step{0}; step < steps_.size(); ++step) {
+    // The previous step may have left other values in the padding
+    if (step > 0) {
+      fits_image->Refill(steps_[step].filling);
+    }
+    const char* kName{steps_[step].name.c_str()};
+    Trace::Scope trace_scope{kName};
+    Perf::Scope perf_scope{kName, kPixels};
+    steps_[step].operation->Operate(fits_image, steps_[step].sel.get());
+  }
+}
+
+long MorphologyChain::Padding() const {
+  long padding{0};
+  for (const Step& step : steps_) {
+    padding = std::max({padding, step.sel->Rows(), step.sel->Columns()});
+  }
+  return padding;
+}
+
+long MorphologyChain::Halo() const {
+  long halo{0};
+  for (const Step& step : steps_) {
+    halo += std::max(step.sel->Rows(), step.sel->Columns());
+  }
+  return halo;
+}
+
+PaddingType MorphologyChain::Filling() const {
+  if (steps_.empty()) {
+    throw std::logic_error("The chain has no operations.");
+  }
+  return steps_.front().filling;
+}
@@ -0,0 +1,196 @@
+/**
+ * @brief Hardware performance counters of the operations, read with
+ *  perf_event_open on Linux.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#include "../include/perf_counters.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+#ifdef __linux__
+  #include <linux/perf_event.h>
+  #include <sys/ioctl.h>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+#endif
+
+namespace {
+  std::mutex phases_mutex;
+  std::map<std::string, Perf::Counts> phases;
+  std::uint64_t vector_event{0};
+
+#ifdef __linux__
+  /**
+   * @brief Opens a counter of the calling thread and of the threads it
+   *  creates, disabled until the group is started.
+   * @param type perf event type.
+   * @param config perf event config.
+   * @param group_descriptor Leader of the group, -1 to lead it.
+   * @returns The descriptor of the counter, -1 if it cannot be opened.
+   */
+  int OpenCounter(std::uint32_t type, std::uint64_t config,
+                  int group_descriptor) {
+    perf_event_attr attributes;
+    std::memset(&attributes, 0, sizeof(attributes));
+    attributes.size = sizeof(attributes);
+    attributes.type = type;
+    attributes.config = config;
+    attributes.disabled = group_descriptor == -1 ? 1 : 0;
+    attributes.inherit = 1;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+    attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                             PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1,
+                                    group_descriptor, 0));
+  }
+#endif
+}
+
+namespace Perf {
+  void Enable(std::uint64_t raw_vector_event) {
+    std::lock_guard<std::mutex> lock{phases_mutex};
+    phases.clear();
+    vector_event = raw_vector_event;
+    enabled.store(true);
+  }
+
+  CounterGroup::CounterGroup() {
+    for (int& descriptor : descriptors_) {
+      descriptor = -1;
+    }
+#ifdef __linux__
+    descriptors_[CYCLES] = OpenCounter(PERF_TYPE_HARDWARE,
+                                       PERF_COUNT_HW_CPU_CYCLES, -1);
+    if (descriptors_[CYCLES] < 0) {
+      return;
+    }
+    descriptors_[INSTRUCTIONS] = OpenCounter(
+      PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, descriptors_[CYCLES]);
+    descriptors_[LLC_MISSES] = OpenCounter(
+      PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, descriptors_[CYCLES]);
+    if (vector_event != 0) {
+      descriptors_[VECTOR] = OpenCounter(PERF_TYPE_RAW, vector_event,
+                                         descriptors_[CYCLES]);
+    }
+#endif
+  }
+
+  CounterGroup::~CounterGroup() {
+#ifdef __linux__
+    for (int descriptor : descriptors_) {
+      if (descriptor >= 0) {
+        close(descriptor);
+      }
+    }
+#endif
+  }
+
+  void CounterGroup::Start() {
+#ifdef __linux__
+    if (descriptors_[CYCLES] >= 0) {
+      ioctl(descriptors_[CYCLES], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+      ioctl(descriptors_[CYCLES], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+  }
+
+  void CounterGroup::Stop(Counts& counts) {
+#ifdef __linux__
+    if (descriptors_[CYCLES] >= 0) {
+      ioctl(descriptors_[CYCLES], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+    for (int counter{0}; counter < kCounters; ++counter) {
+      // Value, time enabled and time running
+      std::uint64_t values[3];
+      if (descriptors_[counter] < 0 ||
+          read(descriptors_[counter], values, sizeof(values)) !=
+            static_cast<ssize_t>(sizeof(values)) ||
+          values[2] == 0) {
+        continue;
+      }
+      counts.values[counter] += static_cast<std::uint64_t>(
+        static_cast<double>(values[0]) * values[1] / values[2]);
+      counts.available[counter] = true;
+    }
+#endif
+  }
+
+  Scope::Scope(const char* phase, double pixels):
+      phase_{phase}, pixels_{pixels}, group_{nullptr} {
+    if (Enabled() && phase_ != nullptr) {
+      group_ = new CounterGroup;
+      group_->Start();
+    }
+  }
+
+  Scope::~Scope() {
+    if (group_ == nullptr) {
+      return;
+    }
+    Counts counts;
+    group_->Stop(counts);
+    delete group_;
+    std::lock_guard<std::mutex> lock{phases_mutex};
+    Counts& phase = phases[phase_];
+    for (int counter{0}; counter < kCounters; ++counter) {
+      phase.values[counter] += counts.values[counter];
+      phase.available[counter] = phase.available[counter] ||
+                                 counts.available[counter];
+    }
+    ++phase.runs;
+    phase.pixels += pixels_;
+  }
+
+  Counts PhaseCounts(const std::string& phase) {
+    std::lock_guard<std::mutex> lock{phases_mutex};
+    auto counts = phases.find(phase);
+    return counts != phases.end() ? counts->second : Counts{};
+  }
+
+  std::string Metrics(const Counts& counts) {
+    std::ostringstream metrics;
+    metrics << std::fixed << std::setprecision(3);
+    if (!counts.available[CYCLES]) {
+      metrics << "counters not available";
+      return metrics.str();
+    }
+    const double kPixels{counts.pixels > 0 ? counts.pixels : 1.0};
+    metrics << "cycles/pixel " << counts.values[CYCLES] / kPixels;
+    if (counts.available[INSTRUCTIONS]) {
+      metrics << ", IPC "
+              << static_cast<double>(counts.values[INSTRUCTIONS]) /
+                 std::max<std::uint64_t>(counts.values[CYCLES], 1)
+              << ", instructions/pixel "
+              << counts.values[INSTRUCTIONS] / kPixels;
+    }
+    if (counts.available[LLC_MISSES]) {
+      metrics << ", LLC bytes/pixel "
+              << counts.values[LLC_MISSES] * kCacheLineBytes / kPixels;
+    }
+    if (counts.available[VECTOR]) {
+      metrics << ", vector/pixel " << counts.values[VECTOR] / kPixels;
+    }
+    return metrics.str();
+  }
+
+  std::string Summary() {
+    std::map<std::string, Counts> phases_copy;
+    {
+      std::lock_guard<std::mutex> lock{phases_mutex};
+      phases_copy = phases;
+    }
+    std::ostringstream summary;
+    for (const auto& [phase, counts] : phases_copy) {
+      summary << phase << ": " << Metrics(counts) << "\n";
+    }
+    return summary.str();
+  }
+}
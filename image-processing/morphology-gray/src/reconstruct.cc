@@ -0,0 +1,50 @@
+/**
+ * @brief Reconstruct class which implements the morphological opening by
+ *  reconstruction.
+ *  
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#ifdef USE_SYCL
+  #include "../include/reconstruct_sycl.h"
+#else
+  #include "../include/reconstruct.h"
+#endif
+
+Morphology* NewReconstruct(int data_type) {
+  Morphology* operation;
+  switch (data_type) {
+    case TBYTE: {
+      operation = new Reconstruct<unsigned char>();
+      break;
+    } case TSBYTE: {
+      operation = new Reconstruct<signed char>();
+      break;
+    } case TSHORT: {
+      operation = new Reconstruct<short>();
+      break;
+    } case TUSHORT: {
+      operation = new Reconstruct<unsigned short>();
+      break;
+    } case TINT: {
+      operation = new Reconstruct<int>();
+      break;
+    } case TUINT: {
+      operation = new Reconstruct<unsigned int>();
+      break;
+    } case TLONGLONG: {
+      operation = new Reconstruct<long long>();
+      break;
+    } case TFLOAT: {
+      operation = new Reconstruct<float>();
+      break;
+    } case TDOUBLE: {
+      operation = new Reconstruct<double>();
+      break;
+    } default: {
+      throw std::invalid_argument("Image pixel size unsupported.");
+      break;
+    }
+  }
+  return operation;
+}
@@ -0,0 +1,50 @@
+/**
+ * @brief StreamingErode class which implements the morphological erosion
+ *  operation as a pipeline of strips of rows.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#ifdef USE_SYCL
+  #include "../include/streaming_erode_sycl.h"
+#else
+  #include "../include/streaming_erode.h"
+#endif
+
+StreamingMorphology* NewStreamingErode(int data_type) {
+  StreamingMorphology* operation;
+  switch (data_type) {
+    case TBYTE: {
+      operation = new StreamingErode<unsigned char>();
+      break;
+    } case TSBYTE: {
+      operation = new StreamingErode<signed char>();
+      break;
+    } case TSHORT: {
+      operation = new StreamingErode<short>();
+      break;
+    } case TUSHORT: {
+      operation = new StreamingErode<unsigned short>();
+      break;
+    } case TINT: {
+      operation = new StreamingErode<int>();
+      break;
+    } case TUINT: {
+      operation = new StreamingErode<unsigned int>();
+      break;
+    } case TLONGLONG: {
+      operation = new StreamingErode<long long>();
+      break;
+    } case TFLOAT: {
+      operation = new StreamingErode<float>();
+      break;
+    } case TDOUBLE: {
+      operation = new StreamingErode<double>();
+      break;
+    } default: {
+      throw std::invalid_argument("Image pixel size unsupported.");
+      break;
+    }
+  }
+  return operation;
+}
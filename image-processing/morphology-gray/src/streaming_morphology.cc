@@ -0,0 +1,10 @@
+/**
+ * @brief StreamingMorphology abstract class that serves as a base for the
+ *  morphology operations that stream the image in strips of rows.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#include "../include/streaming_morphology.h"
+
+StreamingMorphology::~StreamingMorphology() {}
@@ -0,0 +1,234 @@
+/**
+ * @brief Generators of synthetic FITS images and structuring elements for the
+ *  benchmarks.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#include "../include/synthetic.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include <fitsio.h>
+
+namespace {
+  // Stars per million pixels of the star fields.
+  constexpr double kStarsPerMegapixel = 200.0;
+  // Width of the widest star, stars are drawn up to four times it.
+  constexpr double kMaxStarSigma = 3.3;
+
+  /**
+   * @brief Gives the range of values an image type holds once BZERO is
+   *  applied. Floating point images use [0, 65535], as a detector would.
+   * @param bitpix CFITSIO image type.
+   * @param minimum Lowest value.
+   * @param maximum Highest value.
+   */
+  void GetRange(int bitpix, double& minimum, double& maximum) {
+    switch (bitpix) {
+      case BYTE_IMG: {
+        minimum = 0.0;
+        maximum = 255.0;
+        break;
+      } case SBYTE_IMG: {
+        minimum = -128.0;
+        maximum = 127.0;
+        break;
+      } case SHORT_IMG: {
+        minimum = -32768.0;
+        maximum = 32767.0;
+        break;
+      } case USHORT_IMG: {
+        minimum = 0.0;
+        maximum = 65535.0;
+        break;
+      } case LONG_IMG: {
+        minimum = -2147483648.0;
+        maximum = 2147483647.0;
+        break;
+      } case ULONG_IMG: {
+        minimum = 0.0;
+        maximum = 4294967295.0;
+        break;
+      } case LONGLONG_IMG: {
+        // Exactly representable in the doubles written
+        minimum = -9007199254740992.0;
+        maximum = 9007199254740992.0;
+        break;
+      } case FLOAT_IMG:
+      case DOUBLE_IMG: {
+        minimum = 0.0;
+        maximum = 65535.0;
+        break;
+      } default: {
+        throw std::invalid_argument("Image type not supported.");
+        break;
+      }
+    }
+  }
+
+  /**
+   * @brief A gaussian star of a star field.
+   */
+  struct Star {
+    double row;
+    double column;
+    double flux;
+    double sigma;
+  };
+}
+
+namespace Synthetic {
+  Pattern GetPattern(const std::string& name) {
+    if (name == "gradient") {
+      return Pattern::GRADIENT;
+    } else if (name == "noise") {
+      return Pattern::NOISE;
+    } else if (name == "stars") {
+      return Pattern::STARS;
+    }
+    throw std::invalid_argument("Synthetic pattern not supported.");
+  }
+
+  SelShape GetSelShape(const std::string& name) {
+    if (name == "square") {
+      return SelShape::SQUARE;
+    } else if (name == "cross") {
+      return SelShape::CROSS;
+    } else if (name == "disk") {
+      return SelShape::DISK;
+    } else if (name == "line") {
+      return SelShape::LINE;
+    }
+    throw std::invalid_argument("Structuring element shape not supported.");
+  }
+
+  void WriteImage(const std::string& file_name, Pattern pattern, long size,
+                  int bitpix, unsigned seed) {
+    if (size <= 0) {
+      throw std::invalid_argument("Invalid synthetic image size.");
+    }
+    double minimum;
+    double maximum;
+    GetRange(bitpix, minimum, maximum);
+    const double kRange{maximum - minimum};
+    std::mt19937_64 generator{seed};
+    std::uniform_real_distribution<double> unit{0.0, 1.0};
+
+    // Stars sorted by row, so each row only looks at the nearby ones
+    std::vector<Star> stars;
+    if (pattern == Pattern::STARS) {
+      const long kStars{std::max(1L, static_cast<long>(
+        kStarsPerMegapixel * size * size / 1e6))};
+      for (long star{0}; star < kStars; ++star) {
+        stars.push_back({unit(generator) * size, unit(generator) * size,
+                         std::pow(unit(generator), 4.0),
+                         0.8 + (kMaxStarSigma - 0.8) * unit(generator)});
+      }
+      std::sort(stars.begin(), stars.end(), [](const Star& a, const Star& b) {
+        return a.row < b.row;
+      });
+    }
+    constexpr double kStarReach = 4.0 * kMaxStarSigma;
+
+    fitsfile* fits_file;
+    int status{0};
+    const std::string kFileName{"!" + file_name};
+    fits_create_file(&fits_file, kFileName.c_str(), &status);
+    long dimensions[2] = {size, size};
+    fits_create_img(fits_file, bitpix, 2, dimensions, &status);
+    std::vector<double> row_pixels(size);
+    std::size_t first_star{0};
+    for (long row{0}; row < size && status == 0; ++row) {
+      for (long column{0}; column < size; ++column) {
+        double value;
+        switch (pattern) {
+          case Pattern::GRADIENT: {
+            value = static_cast<double>(row + column) / std::max(2 * size - 2, 1L);
+            break;
+          } case Pattern::NOISE: {
+            value = unit(generator);
+            break;
+          } default: { // Background around a tenth of the range
+            value = 0.1 + 0.02 * unit(generator);
+            break;
+          }
+        }
+        row_pixels[column] = value;
+      }
+      if (pattern == Pattern::STARS) {
+        while (first_star < stars.size() &&
+               stars[first_star].row < row - kStarReach) {
+          ++first_star;
+        }
+        for (std::size_t star{first_star};
+            star < stars.size() && stars[star].row <= row + kStarReach;
+            ++star) {
+          const Star& kStar = stars[star];
+          const double kRowDistance{row - kStar.row};
+          const long kFirstColumn{std::max(0L,
+            static_cast<long>(kStar.column - kStarReach))};
+          const long kLastColumn{std::min(size - 1,
+            static_cast<long>(kStar.column + kStarReach))};
+          for (long column{kFirstColumn}; column <= kLastColumn; ++column) {
+            const double kColumnDistance{column - kStar.column};
+            row_pixels[column] += kStar.flux * std::exp(
+              -(kRowDistance * kRowDistance + kColumnDistance * kColumnDistance) /
+              (2.0 * kStar.sigma * kStar.sigma));
+          }
+        }
+      }
+      for (double& pixel : row_pixels) {
+        pixel = std::round(minimum + std::min(pixel, 1.0) * kRange);
+      }
+      long first_pixel[2] = {1, row + 1};
+      fits_write_pix(fits_file, TDOUBLE, first_pixel, size, row_pixels.data(),
+                     &status);
+    }
+    fits_close_file(fits_file, &status);
+    if (status != 0) {
+      throw std::runtime_error("The synthetic image could not be written.");
+    }
+  }
+
+  void WriteSel(const std::string& file_name, SelShape shape, long size) {
+    if (size <= 0 || size % 2 == 0) {
+      throw std::invalid_argument("Structuring element sizes must be odd.");
+    }
+    std::ofstream file{file_name};
+    const long kCenter{size / 2};
+    file << size << " " << size << "\n" << kCenter << " " << kCenter << "\n";
+    for (long row{0}; row < size; ++row) {
+      for (long column{0}; column < size; ++column) {
+        const long kRowDistance{row - kCenter};
+        const long kColumnDistance{column - kCenter};
+        bool cell;
+        switch (shape) {
+          case SelShape::SQUARE: {
+            cell = true;
+            break;
+          } case SelShape::CROSS: {
+            cell = kRowDistance == 0 || kColumnDistance == 0;
+            break;
+          } case SelShape::DISK: {
+            cell = kRowDistance * kRowDistance +
+                   kColumnDistance * kColumnDistance <= kCenter * kCenter;
+            break;
+          } default: {
+            cell = kRowDistance == 0;
+            break;
+          }
+        }
+        file << (column > 0 ? " " : "") << (cell ? 1 : 0);
+      }
+      file << "\n";
+    }
+    if (!file) {
+      throw std::runtime_error("The structuring element could not be written.");
+    }
+  }
+}
@@ -12,9 +12,60 @@
 
 #include "../include/fits_utils.h"
 
+namespace {
+
+/**
+ * @brief Creates the TemplatedFitsImage of the pixel type of the file.
+ * @param fits_file FITS file pointer, at the image HDU.
+ * @param mode The mode the FITS file was opened with.
+ * @param data_type CFITSIO data type of the pixels in memory.
+ * @returns A TemplatedFitsImage object as its base class poiner.
+ */
+FitsImage* NewTemplatedFitsImage(fitsfile* fits_file, OpeningMode mode,
+                                 int data_type) {
+  FitsImage* fits_image;
+  switch (data_type) {
+    case TBYTE: {
+      fits_image = new TemplatedFitsImage<unsigned char>(fits_file, mode);
+      break;
+    } case TSBYTE: {
+      fits_image = new TemplatedFitsImage<signed char>(fits_file, mode);
+      break;
+    } case TSHORT: {
+      fits_image = new TemplatedFitsImage<short>(fits_file, mode);
+      break;
+    } case TUSHORT: {
+      fits_image = new TemplatedFitsImage<unsigned short>(fits_file, mode);
+      break;
+    } case TINT: {
+      fits_image = new TemplatedFitsImage<int>(fits_file, mode);
+      break;
+    } case TUINT: {
+      fits_image = new TemplatedFitsImage<unsigned int>(fits_file, mode);
+      break;
+    } case TLONGLONG: {
+      fits_image = new TemplatedFitsImage<long long>(fits_file, mode);
+      break;
+    } case TFLOAT: {
+      fits_image = new TemplatedFitsImage<float>(fits_file, mode);
+      break;
+    } case TDOUBLE: {
+      fits_image = new TemplatedFitsImage<double>(fits_file, mode);
+      break;
+    } default: {
+      throw std::invalid_argument("Image pixel size unsupported.");
+      break;
+    }
+  }
+  return fits_image;
+}
+
+} // namespace
+
 FitsImage* NewFitsImage(std::string file_name,
                         OpeningMode mode,
                         int creation_bitpix) {
+  Trace::Scope scope{"open"};
   if (file_name.empty()) {
     throw std::invalid_argument("Empty file name is not allowed.");
   }
@@ -24,15 +75,21 @@ FitsImage* NewFitsImage(std::string file_name,
   constexpr int kAmountOfAxis{2};
   long dimensions[kAmountOfAxis] = {0, 0};
   int bitpix;
+  int equivalent_bitpix;
+  double scale{1.0};
   switch (mode) {
     case OpeningMode::OPEN: {
       if (!file_exists) {
         throw std::invalid_argument("The FITS file does not exist.");
       }
-      fits_open_file(&fits_file, file_name.c_str(), READWRITE, &status);
+      // The first image HDU, tile-compressed images are extensions
+      fits_open_image(&fits_file, file_name.c_str(), READWRITE, &status);
       int real_amount_of_axis;
       fits_get_img_param(fits_file, kAmountOfAxis, &bitpix, &real_amount_of_axis,
         dimensions, &status);
+      fits_get_img_equivtype(fits_file, &equivalent_bitpix, &status);
+      int key_status{0};
+      fits_read_key(fits_file, TDOUBLE, "BSCALE", &scale, nullptr, &key_status);
       break;
     } case OpeningMode::CREATE: {
       if (file_exists) {
@@ -41,12 +98,14 @@ FitsImage* NewFitsImage(std::string file_name,
       fits_create_file(&fits_file, file_name.c_str(), &status);
       fits_create_img(fits_file, creation_bitpix, kAmountOfAxis, dimensions, &status);
       bitpix = creation_bitpix;
+      equivalent_bitpix = creation_bitpix;
       break;
     } case OpeningMode::OVERWRITE: {
       file_name = "!" + file_name;
       fits_create_file(&fits_file, file_name.c_str(), &status);
       fits_create_img(fits_file, creation_bitpix, kAmountOfAxis, dimensions, &status);
       bitpix = creation_bitpix;
+      equivalent_bitpix = creation_bitpix;
       break;
     } default: {
       throw std::invalid_argument("Invalid opening mode.");
@@ -55,30 +114,21 @@ FitsImage* NewFitsImage(std::string file_name,
   if (status != 0) {
     throw std::invalid_argument("Templated FITS image creation failed.");
   }
-  FitsImage* fits_image;
-  switch (bitpix) {
-    case BYTE_IMG: {
-      fits_image = new TemplatedFitsImage<unsigned char>(fits_file, mode);
-      break;
-    } case SHORT_IMG: {
-      fits_image = new TemplatedFitsImage<short>(fits_file, mode);
-      break;
-    } case LONG_IMG: {
-      fits_image = new TemplatedFitsImage<long>(fits_file, mode);
-      break;
-    } case LONGLONG_IMG: {
-      fits_image = new TemplatedFitsImage<long long>(fits_file, mode);
-      break;
-    } case FLOAT_IMG: {
-      fits_image = new TemplatedFitsImage<float>(fits_file, mode);
-      break;
-    } case DOUBLE_IMG: {
-      fits_image = new TemplatedFitsImage<double>(fits_file, mode);
-      break;
-    } default: {
-      throw std::invalid_argument("Image pixel size unsupported.");
-      break;
-    }
+  return NewTemplatedFitsImage(fits_file, mode,
+    FitsUtils::GetDataType(bitpix, equivalent_bitpix, scale));
+}
+FitsImage* OpenFitsImage(fitsfile* fits_file) {
+  int status{0};
+  int bitpix;
+  int equivalent_bitpix;
+  double scale{1.0};
+  fits_get_img_type(fits_file, &bitpix, &status);
+  fits_get_img_equivtype(fits_file, &equivalent_bitpix, &status);
+  int key_status{0};
+  fits_read_key(fits_file, TDOUBLE, "BSCALE", &scale, nullptr, &key_status);
+  if (status != 0) {
+    throw std::invalid_argument("The HDU is not an image.");
   }
-  return fits_image;
-}
\ No newline at end of file
+  return NewTemplatedFitsImage(fits_file, OpeningMode::OPEN,
+    FitsUtils::GetDataType(bitpix, equivalent_bitpix, scale));
+}
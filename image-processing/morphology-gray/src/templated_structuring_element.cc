@@ -17,11 +17,20 @@ StructuringElement* NewStructuringElement(const std::string& file_name,
     case TBYTE: {
       sel = new TemplatedStructuringElement<unsigned char>(file_name, data_type);
       break;
+    } case TSBYTE: {
+      sel = new TemplatedStructuringElement<signed char>(file_name, data_type);
+      break;
     } case TSHORT: {
       sel = new TemplatedStructuringElement<short>(file_name, data_type);
       break;
-    } case TLONG: {
-      sel = new TemplatedStructuringElement<long>(file_name, data_type);
+    } case TUSHORT: {
+      sel = new TemplatedStructuringElement<unsigned short>(file_name, data_type);
+      break;
+    } case TINT: {
+      sel = new TemplatedStructuringElement<int>(file_name, data_type);
+      break;
+    } case TUINT: {
+      sel = new TemplatedStructuringElement<unsigned int>(file_name, data_type);
       break;
     } case TLONGLONG: {
       sel = new TemplatedStructuringElement<long long>(file_name, data_type);
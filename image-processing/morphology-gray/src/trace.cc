@@ -0,0 +1,149 @@
+/**
+ * @brief Timing of the phases of a job (reading, padding, transfers, kernels
+ *  and writing), exported as a Chrome trace.
+ *
+ * @author Adriano dos Santos Moreira <alu0101436784@ull.edu.es>
+ */
+
+#include "../include/trace.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace {
+  /**
+   * @brief A finished phase.
+   */
+  struct Event {
+    std::string name;
+    std::int64_t start;
+    std::int64_t duration;
+    std::size_t bytes;
+    int process;
+    int thread;
+  };
+
+  std::mutex events_mutex;
+  std::vector<Event> events;
+  // Labels of the rows by process and thread, kept across traces
+  std::map<std::pair<int, int>, std::string> row_names;
+  std::chrono::steady_clock::time_point trace_start;
+  std::atomic<int> next_thread_id{0};
+
+  // Escapes the characters of a phase name that JSON does not allow.
+  std::string EscapeJson(const std::string& text) {
+    std::string escaped;
+    for (char character : text) {
+      if (character == '"' || character == '\\') {
+        escaped.push_back('\\');
+      }
+      escaped.push_back(character);
+    }
+    return escaped;
+  }
+}
+
+namespace Trace {
+  void Enable() {
+    std::lock_guard<std::mutex> lock{events_mutex};
+    events.clear();
+    trace_start = std::chrono::steady_clock::now();
+    enabled.store(true);
+  }
+
+  std::int64_t Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - trace_start).count();
+  }
+
+  int ThreadId() {
+    thread_local const int kThreadId{next_thread_id++};
+    return kThreadId;
+  }
+
+  void AddEvent(const std::string& name, std::int64_t start,
+                std::int64_t duration, std::size_t bytes, int process,
+                int thread) {
+    std::lock_guard<std::mutex> lock{events_mutex};
+    events.push_back({name, start, duration, bytes, process, thread});
+  }
+
+  void NameRow(int process, int thread, const std::string& name) {
+    std::lock_guard<std::mutex> lock{events_mutex};
+    row_names[{process, thread}] = name;
+  }
+
+  void Write(const std::string& file_name) {
+    std::ofstream file{file_name};
+    std::lock_guard<std::mutex> lock{events_mutex};
+    // Microseconds with nanosecond decimals, as the format expects
+    file << std::fixed << std::setprecision(3) << "{\"traceEvents\": [\n";
+    file << "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": "
+         << kHostProcess << ", \"args\": {\"name\": \"host\"}},\n";
+    file << "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": "
+         << kDeviceProcess << ", \"args\": {\"name\": \"devices\"}}";
+    for (const auto& [row, name] : row_names) {
+      file << ",\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": "
+           << row.first << ", \"tid\": " << row.second
+           << ", \"args\": {\"name\": \"" << EscapeJson(name) << "\"}}";
+    }
+    for (const Event& event : events) {
+      file << ",\n  {\"name\": \"" << EscapeJson(event.name) << "\", "
+           << "\"cat\": \"" << (event.process == kHostProcess ? "host" : "device")
+           << "\", \"ph\": \"X\", \"ts\": " << event.start / 1e3
+           << ", \"dur\": " << event.duration / 1e3
+           << ", \"pid\": " << event.process << ", \"tid\": " << event.thread
+           << ", \"args\": {\"bytes\": " << event.bytes;
+      if (event.bytes > 0 && event.duration > 0) {
+        file << ", \"GB/s\": "
+             << static_cast<double>(event.bytes) / event.duration;
+      }
+      file << "}}";
+    }
+    file << "\n], \"displayTimeUnit\": \"ns\"}\n";
+    if (!file) {
+      throw std::runtime_error("The trace file could not be written.");
+    }
+  }
+
+  std::string Summary() {
+    struct Phase {
+      long count{0};
+      std::int64_t duration{0};
+      std::size_t bytes{0};
+    };
+    std::map<std::string, Phase> phases;
+    {
+      std::lock_guard<std::mutex> lock{events_mutex};
+      for (const Event& event : events) {
+        Phase& phase = phases[event.name];
+        ++phase.count;
+        phase.duration += event.duration;
+        phase.bytes += event.bytes;
+      }
+    }
+    std::ostringstream summary;
+    summary << std::fixed << std::setprecision(6);
+    for (const auto& [name, phase] : phases) {
+      summary << name << ": " << phase.duration * 1e-9 << " (s), "
+              << phase.count << " time(s)";
+      if (phase.bytes > 0) {
+        summary << ", " << phase.bytes << " bytes";
+        if (phase.duration > 0) {
+          summary << ", " << std::setprecision(3)
+                  << static_cast<double>(phase.bytes) / phase.duration
+                  << " GB/s" << std::setprecision(6);
+        }
+      }
+      summary << "\n";
+    }
+    return summary.str();
+  }
+}
@@ -6,15 +6,227 @@
 
 #include "../include/utils.h"
 
+#include <cstdlib>
 #include <fitsio.h>
+#include <sstream>
+#include <vector>
 
 #ifdef USE_SYCL
   #include "../include/erode_sycl.h"
+  #include "../include/dilate_sycl.h"
+  #include "../include/heterogeneous_erode_sycl.h"
+  #include "../include/streaming_erode_sycl.h"
+  #include "../include/reconstruct_sycl.h"
 #else
   #include "../include/erode.h"
+  #include "../include/dilate.h"
+  #include "../include/reconstruct.h"
+  #include "../include/streaming_erode.h"
 #endif
 
 #include "../include/fits_image.h"
+#include "../include/morphology_chain.h"
+#include "../include/templated_structuring_element.h"
+
+bool ParseArguments(int argc, char* argv[], Options& options) {
+  std::vector<std::string> arguments;
+  bool batch{false};
+  for (int index{1}; index < argc; ++index) {
+    std::string argument{argv[index]};
+    if (argument.rfind("--", 0) != 0) {
+      arguments.push_back(argument);
+    } else if (argument == "--hetero") {
+      options.heterogeneous = true;
+    } else if (argument == "--stream") {
+      options.strip_rows = kDefaultStripRows;
+    } else if (argument.rfind("--stream=", 0) == 0) {
+      options.strip_rows = std::stol(argument.substr(9));
+      if (options.strip_rows <= 0) {
+        return false;
+      }
+    } else if (argument.rfind("--max-memory=", 0) == 0) {
+      options.max_memory = ParseMemorySize(argument.substr(13));
+    } else if (argument == "--compress") {
+      options.compression_type = RICE_1;
+    } else if (argument.rfind("--compress=", 0) == 0) {
+      options.compression_type = GetCompressionType(argument.substr(11));
+    } else if (argument.rfind("--pool-memory=", 0) == 0) {
+      options.pool_memory = ParseMemorySize(argument.substr(14));
+    } else if (argument.rfind("--io-threads=", 0) == 0) {
+      options.io_threads = std::stoi(argument.substr(13));
+      if (options.io_threads <= 0) {
+        return false;
+      }
+    } else if (argument.rfind("--roi=", 0) == 0) {
+      options.roi = ParseRegion(argument.substr(6));
+    } else if (argument == "--perf") {
+      options.perf = true;
+    } else if (argument.rfind("--perf=", 0) == 0) {
+      options.perf = true;
+      options.perf_vector_event = std::stoull(argument.substr(7), nullptr, 16);
+    } else if (argument.rfind("--trace=", 0) == 0) {
+      options.trace_file_name = argument.substr(8);
+      if (options.trace_file_name.empty()) {
+        return false;
+      }
+    } else if (argument == "--serve") {
+      options.serve_socket = kDefaultServeSocket;
+    } else if (argument.rfind("--serve=", 0) == 0) {
+      options.serve_socket = argument.substr(8);
+      if (options.serve_socket.empty()) {
+        return false;
+      }
+    } else if (argument.rfind("--serve-workers=", 0) == 0) {
+      options.serve_workers = std::stoi(argument.substr(16));
+      if (options.serve_workers <= 0) {
+        return false;
+      }
+    } else if (argument.rfind("--serve-queue=", 0) == 0) {
+      options.serve_queue = std::stoi(argument.substr(14));
+      if (options.serve_queue <= 0) {
+        return false;
+      }
+    } else if (argument == "--batch") {
+      batch = true;
+    } else if (argument.rfind("--batch-threads=", 0) == 0) {
+      std::stringstream threads{argument.substr(16)};
+      std::string load, compute, write;
+      if (!std::getline(threads, load, ',') ||
+          !std::getline(threads, compute, ',') ||
+          !std::getline(threads, write)) {
+        return false;
+      }
+      options.batch_load_threads = std::stoi(load);
+      options.batch_compute_threads = std::stoi(compute);
+      options.batch_write_threads = std::stoi(write);
+      if (options.batch_load_threads <= 0 ||
+          options.batch_compute_threads <= 0 ||
+          options.batch_write_threads <= 0) {
+        return false;
+      }
+    } else if (argument.rfind("--batch-queue=", 0) == 0) {
+      options.batch_queue = std::stoi(argument.substr(14));
+      if (options.batch_queue <= 0) {
+        return false;
+      }
+    } else if (argument.rfind("--plane-threads=", 0) == 0) {
+      options.plane_threads = std::stoi(argument.substr(16));
+      if (options.plane_threads <= 0) {
+        return false;
+      }
+    } else {
+      return false;
+    }
+  }
+  if (!options.serve_socket.empty()) {
+    return arguments.empty() && !batch;
+  }
+  if (batch) {
+    if (arguments.size() != 1) {
+      return false;
+    }
+    options.batch_file_name = arguments[0];
+    return true;
+  }
+  if (arguments.size() != 4 && arguments.size() != 5) {
+    return false;
+  }
+  options.image_file_name = arguments[0];
+  options.sel_file_name = arguments[1];
+  options.output_file_name = arguments[2];
+  options.operation = arguments[3];
+  if (arguments.size() == 5) {
+    options.threshold_type = GetThresholdType(arguments[4]);
+  }
+  return true;
+}
+
+void EnablePersistentKernelCache() {
+#ifdef USE_SYCL
+  setenv("SYCL_CACHE_PERSISTENT", "1", 0);
+#endif
+}
+
+void SetDevicePoolLimit(std::size_t bytes) {
+#ifdef USE_SYCL
+  DevicePool::Instance().SetIdleLimit(bytes);
+#endif
+}
+
+int GetCompressionType(const std::string& compression) {
+  if (compression == "rice") {
+    return RICE_1;
+  } else if (compression == "gzip") {
+    return GZIP_1;
+  } else if (compression == "hcompress") {
+    return HCOMPRESS_1;
+  }
+  throw std::invalid_argument("Compression type not supported.");
+}
+
+PixelBox ParseRegion(std::string region) {
+  if (region.size() > 1 && region.front() == '[' && region.back() == ']') {
+    region = region.substr(1, region.size() - 2);
+  }
+  std::vector<long> values;
+  std::string separators;
+  for (std::size_t position{0}; position < region.size(); ++position) {
+    std::size_t digits;
+    values.push_back(std::stol(region.substr(position), &digits));
+    position += digits;
+    if (position < region.size()) {
+      separators.push_back(region[position]);
+    }
+  }
+  PixelBox box;
+  if (separators == ":,:" && values.size() == 4) {
+    box.first_column = values[0] - 1;
+    box.columns = values[1] - values[0] + 1;
+    box.first_row = values[2] - 1;
+    box.rows = values[3] - values[2] + 1;
+  } else if (separators == ",,," && values.size() == 4) {
+    box.columns = values[2];
+    box.rows = values[3];
+    box.first_column = values[0] - 1 - box.columns / 2;
+    box.first_row = values[1] - 1 - box.rows / 2;
+  } else {
+    throw std::invalid_argument("Invalid region.");
+  }
+  if (box.columns <= 0 || box.rows <= 0) {
+    throw std::invalid_argument("Invalid region.");
+  }
+  return box;
+}
+
+std::size_t ParseMemorySize(const std::string& size) {
+  std::size_t digits;
+  const double kAmount{std::stod(size, &digits)};
+  std::size_t multiplier{1};
+  if (digits < size.size()) {
+    if (digits + 1 != size.size()) {
+      throw std::invalid_argument("Invalid memory size.");
+    }
+    switch (size[digits]) {
+      case 'K': {
+        multiplier = std::size_t{1} << 10;
+        break;
+      } case 'M': {
+        multiplier = std::size_t{1} << 20;
+        break;
+      } case 'G': {
+        multiplier = std::size_t{1} << 30;
+        break;
+      } default: {
+        throw std::invalid_argument("Invalid memory size.");
+        break;
+      }
+    }
+  }
+  if (kAmount <= 0) {
+    throw std::invalid_argument("Invalid memory size.");
+  }
+  return static_cast<std::size_t>(kAmount * multiplier);
+}
 
 Morphology* GetMorphologyOperation(std::string operation, int data_type) {
   if (operation.size() > 1) {
@@ -25,6 +237,12 @@ Morphology* GetMorphologyOperation(std::string operation, int data_type) {
     case 'e': {
       operation_function = NewErode(data_type);
       break;
+    } case 'd': {
+      operation_function = NewDilate(data_type);
+      break;
+    } case 'r': {
+      operation_function = NewReconstruct(data_type);
+      break;
     } default: {
       throw std::invalid_argument("Morphology operation not supported.");
       break;
@@ -33,6 +251,146 @@ Morphology* GetMorphologyOperation(std::string operation, int data_type) {
   return operation_function;
 }
 
+MorphologyChain* NewMorphologyChain(const std::string& operations,
+                                    const std::string& sel_file_names,
+                                    int data_type, bool heterogeneous,
+                                    ThresholdType threshold_type) {
+  std::vector<std::string> sel_files;
+  std::size_t start{0};
+  for (std::size_t comma{sel_file_names.find(',')};
+      comma != std::string::npos;
+      start = comma + 1, comma = sel_file_names.find(',', start)) {
+    sel_files.push_back(sel_file_names.substr(start, comma - start));
+  }
+  sel_files.push_back(sel_file_names.substr(start));
+  if (operations.empty() || sel_files.size() != operations.size()) {
+    throw std::invalid_argument("Each operation needs its own SE file.");
+  }
+  MorphologyChain* chain{new MorphologyChain};
+  try {
+    for (std::size_t step{0}; step < operations.size(); ++step) {
+      const std::string kOperation(1, operations[step]);
+      const bool kHeterogeneous{heterogeneous && kOperation == "e"};
+      Morphology* operation = kHeterogeneous ?
+        GetHeterogeneousOperation(kOperation, data_type) :
+        GetMorphologyOperation(kOperation, data_type);
+      if (step == 0) {
+        operation->SetThreshold(threshold_type);
+      }
+      chain->AddStep(operation,
+                     NewStructuringElement(sel_files[step], data_type),
+                     GetFillingType(kOperation),
+                     (kHeterogeneous ? "hetero " : "") +
+                       GetOperationName(kOperation));
+    }
+  } catch (...) {
+    delete chain;
+    throw;
+  }
+  return chain;
+}
+
+Morphology* GetHeterogeneousOperation(std::string operation, int data_type) {
+#ifdef USE_SYCL
+  if (operation.size() > 1) {
+    throw std::invalid_argument("Morphology operation not supported.");
+  }
+  Morphology* operation_function;
+  switch (operation[0]) {
+    case 'e': {
+      operation_function = NewHeterogeneousErode(data_type);
+      break;
+    } default: {
+      throw std::invalid_argument("Morphology operation not supported.");
+      break;
+    }
+  }
+  return operation_function;
+#else
+  throw std::invalid_argument("Heterogeneous mode requires the SYCL build.");
+#endif
+}
+
+StreamingMorphology* GetStreamingOperation(std::string operation,
+                                           int data_type) {
+  if (operation.size() > 1) {
+    throw std::invalid_argument("Morphology operation not supported.");
+  }
+  StreamingMorphology* operation_function;
+  switch (operation[0]) {
+    case 'e': {
+      operation_function = NewStreamingErode(data_type);
+      break;
+    } default: {
+      throw std::invalid_argument("Morphology operation cannot be streamed.");
+      break;
+    }
+  }
+  return operation_function;
+}
+
+bool IsLocalOperation(std::string operation) {
+  bool local{true};
+  for (char step : operation) {
+    switch (step) {
+      case 'e': // Erosion
+      case 'd': { // Dilation
+        break;
+      } case 'r': { // Opening by reconstruction, propagates through the image
+        local = false;
+        break;
+      } default: {
+        throw std::invalid_argument("Morphology operation not supported.");
+        break;
+      }
+    }
+  }
+  return local;
+}
+
+ThresholdType GetThresholdType(std::string threshold) {
+  if (threshold.size() > 1) {
+    throw std::invalid_argument("Threshold type not supported.");
+  }
+  ThresholdType threshold_type;
+  switch (threshold[0]) {
+    case 'm': {
+      threshold_type = ThresholdType::MEDIAN;
+      break;
+    } case 'a': {
+      threshold_type = ThresholdType::MEAN;
+      break;
+    } default: {
+      throw std::invalid_argument("Threshold type not supported.");
+      break;
+    }
+  }
+  return threshold_type;
+}
+
+std::string GetOperationName(std::string operation) {
+  if (operation.size() > 1) {
+    throw std::invalid_argument("Morphology operation not supported.");
+  }
+  std::string name;
+  switch (operation[0]) {
+    case 'e': {
+      name = "erode";
+      break;
+    } case 'd': {
+      name = "dilate";
+      break;
+    } case 'r': {
+      name = "reconstruct";
+      break;
+    } default: {
+      throw std::invalid_argument("Morphology operation not supported.");
+      break;
+    }
+  }
+  return name;
+}
+
 PaddingType GetFillingType(std::string operation) {
   if (operation.size() > 1) {
     throw std::invalid_argument("Morphology operation not supported.");
@@ -42,6 +400,12 @@ PaddingType GetFillingType(std::string operation) {
     case 'e': { // Erosion
       filling = PaddingType::MAX;
       break;
+    } case 'd': { // Dilation
+      filling = PaddingType::MIN;
+      break;
+    } case 'r': { // Opening by reconstruction, starts with an erosion
+      filling = PaddingType::MAX;
+      break;
     } default: {
       throw std::invalid_argument("Morphology operation not supported.");
       break;